@@ -0,0 +1,25 @@
+#pragma once
+#include "types.hpp"
+#include "HyprloadPlugin.hpp"
+
+#include <filesystem>
+#include <string>
+#include <variant>
+
+namespace hyprload::artifact {
+    // Where a prebuilt binary lives in a store, <name>/<revision>/<hyprland commit>.so
+    std::filesystem::path getArtifactPath(const std::string& name, const std::string& revision);
+
+    // Look the plugin up in the configured store, and put it in the build cache under the key
+    // if it's there, so deploying it is the same as deploying a cached build. Its record has to
+    // match it and the running Hyprland.
+    hyprload::Result<std::monostate, std::string> fetchArtifact(const std::string& name,
+                                                                const std::string& revision,
+                                                                const std::string& cacheKey);
+
+    // Copy the plugin's deployed binary into the configured store, along with a record of what it
+    // was built from. The binary is stored once per digest and linked to under each key. Only
+    // published if it is the binary the lockfile describes.
+    hyprload::Result<std::monostate, std::string> publishArtifact(const std::string& name,
+                                                                  const plugin::PluginSource& source);
+}
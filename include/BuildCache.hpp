@@ -0,0 +1,31 @@
+#pragma once
+#include "types.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace hyprload::cache {
+    // Everything that goes into a plugin binary. Sources without a revision are not cached.
+    struct SBuildInputs {
+        std::string m_sName;
+        std::string m_sRevision;
+        std::vector<std::string> m_vBuildSteps;
+        std::filesystem::path m_pBinaryOutputPath;
+        std::string m_sHyprlandCommit;
+    };
+
+    std::string getCacheKey(const SBuildInputs& inputs);
+
+    std::optional<std::filesystem::path> findArtifact(const std::string& key);
+
+    // Store a built binary under the key, replacing the entry atomically
+    hyprload::Result<std::monostate, std::string>
+    storeArtifact(const std::string& key, const std::filesystem::path& binary);
+
+    // Reflink or hard link the cached binary to the target, copying if it is on another filesystem
+    hyprload::Result<std::monostate, std::string>
+    restoreArtifact(const std::string& key, const std::filesystem::path& target);
+}
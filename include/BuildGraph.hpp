@@ -0,0 +1,58 @@
+#pragma once
+#include "types.hpp"
+#include "BuildProcessDescriptor.hpp"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace hyprload {
+    enum eBuildPriority {
+        BUILD_PRIORITY_PLUGIN = 0,
+        BUILD_PRIORITY_SELF,
+        BUILD_PRIORITY_HEADERS,
+    };
+
+    typedef std::function<hyprload::Result<std::monostate, std::string>()> BuildWork;
+
+    // One step of a build, run once all of its dependencies succeeded. If any of them failed,
+    // the node is not run and fails with the same error.
+    class BuildNode final : public std::enable_shared_from_this<BuildNode> {
+      public:
+        BuildNode(std::string&& key, BuildWork&& work, eBuildPriority priority);
+
+        void dependOn(const std::shared_ptr<BuildNode>& dependency);
+
+        // Descriptors that get this node's result once it finishes
+        void report(const std::shared_ptr<BuildProcessDescriptor>& descriptor);
+
+        std::string m_sKey;
+        BuildWork m_fWork;
+        eBuildPriority m_ePriority;
+
+        std::vector<std::shared_ptr<BuildNode>> m_vDependents;
+        std::vector<std::shared_ptr<BuildProcessDescriptor>> m_vDescriptors;
+
+        // Owned by the scheduler once the graph is submitted
+        usize m_iPendingDependencies = 0;
+        std::optional<hyprload::Result<std::monostate, std::string>> m_rResult;
+    };
+
+    // Nodes are keyed by what they work on, so requirements sharing a source share its nodes
+    class BuildGraph final {
+      public:
+        std::shared_ptr<BuildNode> findNode(const std::string& key) const;
+        std::shared_ptr<BuildNode> addNode(std::string&& key, BuildWork&& work,
+                                           eBuildPriority priority = BUILD_PRIORITY_PLUGIN);
+
+        const std::vector<std::shared_ptr<BuildNode>>& getNodes() const;
+
+      private:
+        std::unordered_map<std::string, std::shared_ptr<BuildNode>> m_mNodesByKey;
+        std::vector<std::shared_ptr<BuildNode>> m_vNodes;
+    };
+}
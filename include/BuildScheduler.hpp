@@ -0,0 +1,59 @@
+#pragma once
+#include "types.hpp"
+#include "BuildGraph.hpp"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+namespace hyprload {
+    // A fixed pool of joinable workers that run the nodes of submitted build graphs as soon as
+    // their dependencies are done, highest priority first and in submission order otherwise.
+    // onReport is called from a worker whenever a node hands its result to descriptors.
+    class BuildScheduler final {
+      public:
+        BuildScheduler(usize jobs, std::function<void()>&& onReport);
+        ~BuildScheduler();
+
+        BuildScheduler(const BuildScheduler&) = delete;
+        BuildScheduler& operator=(const BuildScheduler&) = delete;
+
+        void submit(const BuildGraph& graph);
+
+        // Drop all queued nodes and join the workers, waiting for running nodes to finish
+        void shutdown();
+
+        usize getJobCount() const;
+
+      private:
+        struct SQueuedNode {
+            std::shared_ptr<BuildNode> m_pNode;
+            u64 m_iSequence;
+
+            bool operator<(const SQueuedNode& other) const;
+        };
+
+        void workerLoop();
+
+        // Both expect m_mMutex to be held
+        void enqueue(const std::shared_ptr<BuildNode>& node);
+        void finish(const std::shared_ptr<BuildNode>& node,
+                    hyprload::Result<std::monostate, std::string>&& result);
+
+        usize m_iJobCount;
+        std::function<void()> m_fOnReport;
+        std::vector<std::thread> m_vWorkers;
+
+        std::mutex m_mMutex;
+        std::condition_variable m_cvJobs;
+        std::priority_queue<SQueuedNode> m_qJobs;
+        u64 m_iNextSequence = 0;
+        bool m_bShuttingDown = false;
+    };
+}
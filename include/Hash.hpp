@@ -0,0 +1,31 @@
+#pragma once
+#include "types.hpp"
+
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace hyprload::hash {
+    // Incremental SHA-256, hex encoded
+    class Sha256 final {
+      public:
+        Sha256();
+
+        void update(const void* data, usize length);
+        void update(std::string_view data);
+        std::string finish();
+
+      private:
+        void transform(const u8* block);
+
+        std::array<u32, 8> m_aState;
+        std::array<u8, 64> m_aBuffer;
+        usize m_iBufferLength = 0;
+        u64 m_iTotalLength = 0;
+    };
+
+    std::string sha256(std::string_view data);
+    std::optional<std::string> sha256File(const std::filesystem::path& path);
+}
@@ -4,36 +4,52 @@
 
 #include "HyprloadPlugin.hpp"
 #include "BuildProcessDescriptor.hpp"
+#include "BuildGraph.hpp"
+#include "BuildScheduler.hpp"
 
 #include <memory>
 #include <mutex>
 #include <variant>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <optional>
 #include <filesystem>
 #include <condition_variable>
 
+#include <sys/types.h>
+
 #include <hyprland/src/helpers/Color.hpp>
 #include <hyprland/src/helpers/Monitor.hpp>
 #include <hyprland/src/render/Texture.hpp>
 
-namespace hyprload {
-    void tryCleanupPreviousSessions();
+struct wl_event_source;
 
+namespace hyprload {
     class Hyprload final {
       public:
         Hyprload();
 
         bool checkIfHyprloadFullyCompatible();
 
-        void handleTick();
+        void handleBuildEvents();
 
         void installPlugins();
         void updatePlugins();
+        // Build and install these requirements, without checking their sources for updates
+        void buildPlugins(const std::vector<plugin::PluginRequirement>& requirements);
+        bool isBuilding() const;
+        // Copy the installed plugins into the artifact store, for other machines to fetch
+        void publishPlugins();
+        // Go back to the plugin binaries from before the last install, update or removal
+        void rollbackPlugins();
+        void setupSourceWatcher();
+        void shutdownBuildScheduler();
 
         void loadPlugins();
         void reloadPlugins();
+        // Load the deferred plugin providing the dispatcher, then run the dispatcher
+        void loadLazyPlugin(const std::string& dispatcher, const std::string& argument);
 
         bool lockSession();
         void unlockSession();
@@ -44,26 +60,80 @@ namespace hyprload {
         // Cleanup specific to *this* plugin
         void cleanupPlugin();
 
+        // Remove sessions left behind by crashes. Call once plugins are loaded, so the current
+        // session is locked.
+        void cleanupPreviousSessions();
+
         const std::vector<std::string>& getLoadedPlugins() const;
         bool isPluginLoaded(const std::string& name) const;
         const std::string& getCurrentHyprlandCommitHash();
 
       private:
+        // Identifies a deployed binary, which is always replaced rather than written to
+        struct SBinaryIdentity {
+            dev_t m_iDevice;
+            ino_t m_iInode;
+            off_t m_iSize;
+            i64 m_iModified;
+
+            bool operator==(const SBinaryIdentity& other) const = default;
+        };
+
+        static std::optional<SBinaryIdentity> getBinaryIdentity(const std::filesystem::path& path);
+
+        // A use of a lazy plugin's stub, run from an idle callback once the stub has returned
+        struct SLazyDispatch {
+            std::string m_sPlugin;
+            std::string m_sDispatcher;
+            std::string m_sArgument;
+            wl_event_source* m_pSource = nullptr;
+        };
+
+        static void onLazyDispatch(void* data);
+        // Drop the dispatches not run yet, of the plugin or of all of them
+        void removeLazyDispatches(const std::optional<std::string>& plugin);
+
+        // Where the loaded binary of the plugin is in the session
+        std::filesystem::path getStagedPluginPath(const std::string& plugin);
+        // Put a deployed binary into the session, without loading it
+        bool stagePlugin(const std::string& plugin);
+        void loadStagedPlugins(const std::vector<std::string>& pluginFiles);
+        // The dispatchers of the lazy plugins among these, from their manifests
+        std::unordered_map<std::string, std::vector<std::string>>
+        getLazyDispatchers(const std::vector<std::string>& pluginFiles);
+        // Stub the dispatchers of lazy plugins instead of loading them, returns the rest
+        std::vector<std::string> deferLazyPlugins(
+            const std::vector<std::string>& pluginFiles,
+            const std::unordered_map<std::string, std::vector<std::string>>& lazyDispatchers);
+        void unloadPlugin(const std::string& plugin);
+        void removeUnwantedBinaries();
+
         std::optional<std::filesystem::path> getSessionBinariesPath();
+        void setupBuildScheduler();
         std::string generateSessionGuid();
-        void setupHeaders();
+        std::shared_ptr<BuildNode> setupHeaders(BuildGraph& graph);
         void setupPkgConfig();
         void writePkgConfig(std::ofstream& file, const std::string& hyprlandHeadersPath);
         std::string fetchHyprlandCommitHash();
 
         std::vector<std::string> m_vPlugins;
+        std::unordered_map<std::string, SBinaryIdentity> m_mPluginBinaries;
+        // Staged plugins that aren't loaded yet, to the dispatchers stubbed for them
+        std::unordered_map<std::string, std::vector<std::string>> m_mLazyPlugins;
+        std::vector<std::unique_ptr<SLazyDispatch>> m_vLazyDispatches;
         std::optional<std::string> m_sSessionGuid;
         std::optional<flock_t> m_iSessionLock;
 
         std::string m_sHyprlandCommitNow;
+        std::once_flag m_fHyprlandCommitFetched;
 
         bool m_bIsBuilding = false;
         std::vector<std::shared_ptr<BuildProcessDescriptor>> m_vBuildProcesses;
+        // Plugins deployed by the running builds, committed together once they all finish
+        std::vector<std::string> m_vStagedPlugins;
+        std::unique_ptr<BuildScheduler> m_pBuildScheduler;
+        fd_t m_iBuildEventFd = -1;
+        wl_event_source* m_pBuildEventSource = nullptr;
     };
 
     inline std::unique_ptr<Hyprload> g_pHyprload;
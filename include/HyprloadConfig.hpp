@@ -18,12 +18,14 @@ namespace hyprload::config {
         HyprloadConfig();
 
         void reloadConfig();
-        const toml::table& getConfig() const;
-        const std::vector<hyprload::plugin::PluginRequirement>& getPlugins() const;
+        // The config is parsed on first use, startup doesn't need it when nothing changed
+        const toml::table& getConfig();
+        const std::vector<hyprload::plugin::PluginRequirement>& getPlugins();
 
       private:
         void parseConfig();
 
+        bool m_bParsed = false;
         std::unique_ptr<toml::table> m_pConfig;
         std::vector<hyprload::plugin::PluginRequirement> m_vPluginsWanted;
     };
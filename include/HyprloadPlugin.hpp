@@ -6,10 +6,17 @@
 #include <memory>
 #include <string>
 #include <filesystem>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
 namespace hyprload::plugin {
+    enum eFetchStrategy {
+        FETCH_FULL = 0,
+        FETCH_PARTIAL, // Blob-less clone, blobs are fetched when checked out
+        FETCH_SHALLOW, // Only the wanted commit, at depth 1
+    };
+
     class PluginManifest {
       public:
         PluginManifest(std::string&& name, const toml::table& manifest);
@@ -21,6 +28,8 @@ namespace hyprload::plugin {
 
         const std::filesystem::path& getBinaryOutputPath() const;
         const std::vector<std::string>& getBuildSteps() const;
+        // Dispatchers the plugin registers, so it can be loaded when one is first used
+        const std::vector<std::string>& getDispatchers() const;
 
       private:
         std::string m_sName;
@@ -30,6 +39,7 @@ namespace hyprload::plugin {
 
         std::filesystem::path m_pBinaryOutputPath;
         std::vector<std::string> m_sBuildSteps;
+        std::vector<std::string> m_vDispatchers;
     };
 
     class HyprloadManifest {
@@ -37,16 +47,29 @@ namespace hyprload::plugin {
         HyprloadManifest(const toml::table& manifest);
 
         const std::vector<PluginManifest>& getPlugins() const;
+        const PluginManifest* findPlugin(const std::string& name) const;
 
       private:
         std::vector<PluginManifest> m_vPlugins;
+        std::unordered_map<std::string, usize> m_mPluginsByName;
     };
 
+    // The manifest of a plugin in the source's hyprload.toml
+    hyprload::Result<std::shared_ptr<const PluginManifest>, std::string>
+    getPluginManifest(const std::filesystem::path& sourcePath, const std::string& name);
+
     class PluginSource {
       public:
         virtual ~PluginSource() = default;
 
+        // Identifies the source checkout, equivalent sources have the same identifier
+        virtual std::string getIdentifier() const = 0;
+        // The exact revision checked out, if the source has one
+        virtual std::optional<std::string> getRevision() const = 0;
+        virtual std::filesystem::path getSourcePath() const = 0;
+
         [[nodiscard]] virtual hyprload::Result<std::monostate, std::string> installSource() = 0;
+        [[nodiscard]] virtual hyprload::Result<std::monostate, std::string> updateSource() = 0;
         virtual bool isSourceAvailable() = 0;
         virtual bool isUpToDate() = 0;
         virtual bool providesPlugin(const std::string& name) const = 0;
@@ -55,6 +78,9 @@ namespace hyprload::plugin {
         update(const std::string& name) = 0;
         [[nodiscard]] virtual hyprload::Result<std::monostate, std::string>
         build(const std::string& name) = 0;
+        // Put an already built plugin binary in place
+        [[nodiscard]] virtual hyprload::Result<std::monostate, std::string>
+        deploy(const std::string& name) = 0;
         [[nodiscard]] virtual hyprload::Result<std::monostate, std::string>
         install(const std::string& name) = 0;
 
@@ -67,9 +93,16 @@ namespace hyprload::plugin {
     class GitPluginSource : public PluginSource {
       public:
         GitPluginSource(std::string&& url, std::optional<std::string>&& branch,
-                        std::optional<std::string>&& rev);
+                        std::optional<std::string>&& rev,
+                        eFetchStrategy fetchStrategy = FETCH_PARTIAL,
+                        std::vector<std::string>&& sparsePaths = {});
+
+        std::string getIdentifier() const override;
+        std::optional<std::string> getRevision() const override;
+        std::filesystem::path getSourcePath() const override;
 
         hyprload::Result<std::monostate, std::string> installSource() override;
+        hyprload::Result<std::monostate, std::string> updateSource() override;
         bool isSourceAvailable() override;
         bool isUpToDate() override;
         bool providesPlugin(const std::string& name) const override;
@@ -79,23 +112,48 @@ namespace hyprload::plugin {
         hyprload::Result<std::monostate, std::string>
         build(const std::string& name) override;
         hyprload::Result<std::monostate, std::string>
+        deploy(const std::string& name) override;
+        hyprload::Result<std::monostate, std::string>
         install(const std::string& name) override;
 
+        // Requirements sharing this source may each want different paths checked out
+        void mergeSparsePaths(const GitPluginSource& other);
+
       protected:
         bool isEquivalent(const PluginSource& other) const override;
 
       private:
+        hyprload::Result<std::monostate, std::string> applySparseCheckout();
+
+        // Checkouts of a url share one bare mirror of it, so pinned variants cost no objects
+        bool usesMirror() const;
+        bool isMirrorCheckout() const;
+        std::filesystem::path getMirrorPath() const;
+        // Also fetches the blobs of the revision about to be checked out into the mirror
+        hyprload::Result<std::monostate, std::string> syncMirror(bool fetch,
+                                                                 const std::string& checkout);
+        void fetchMirrorBlobs(const std::string& checkout);
+
         std::string m_sUrl;
         std::optional<std::string> m_sBranch;
         std::optional<std::string> m_sRev;
         std::filesystem::path m_pSourcePath;
+
+        eFetchStrategy m_eFetchStrategy;
+        // Empty means the whole tree
+        std::vector<std::string> m_vSparsePaths;
     };
 
     class LocalPluginSource : public PluginSource {
       public:
         LocalPluginSource(std::filesystem::path&& source);
 
+        std::string getIdentifier() const override;
+        std::optional<std::string> getRevision() const override;
+        std::filesystem::path getSourcePath() const override;
+
         hyprload::Result<std::monostate, std::string> installSource() override;
+        hyprload::Result<std::monostate, std::string> updateSource() override;
         bool isSourceAvailable() override;
         bool isUpToDate() override;
         bool providesPlugin(const std::string& name) const override;
@@ -105,6 +163,8 @@ namespace hyprload::plugin {
         hyprload::Result<std::monostate, std::string>
         build(const std::string& name) override;
         hyprload::Result<std::monostate, std::string>
+        deploy(const std::string& name) override;
+        hyprload::Result<std::monostate, std::string>
         install(const std::string& name) override;
 
       protected:
@@ -118,7 +178,12 @@ namespace hyprload::plugin {
       public:
         SelfSource();
 
+        std::string getIdentifier() const override;
+        std::optional<std::string> getRevision() const override;
+        std::filesystem::path getSourcePath() const override;
+
         hyprload::Result<std::monostate, std::string> installSource() override;
+        hyprload::Result<std::monostate, std::string> updateSource() override;
         bool isSourceAvailable() override;
         bool isUpToDate() override;
         bool providesPlugin(const std::string& name) const override;
@@ -128,6 +193,8 @@ namespace hyprload::plugin {
         hyprload::Result<std::monostate, std::string>
         build(const std::string& name) override;
         hyprload::Result<std::monostate, std::string>
+        deploy(const std::string& name) override;
+        hyprload::Result<std::monostate, std::string>
         install(const std::string& name) override;
 
       protected:
@@ -145,9 +212,12 @@ namespace hyprload::plugin {
         std::shared_ptr<PluginSource> getSource() const;
 
         bool isInstalled() const;
+        // Load the plugin only once one of its dispatchers is used
+        bool isLazy() const;
 
       private:
         std::string m_sName;
+        bool m_bLazy = false;
         std::shared_ptr<PluginSource> m_pSource;
         std::filesystem::path m_pBinaryPath;
     };
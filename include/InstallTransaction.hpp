@@ -0,0 +1,31 @@
+#pragma once
+#include "types.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace hyprload::install {
+    // Deploys put binaries here, nothing loads them until they are committed
+    std::filesystem::path getStagedBinaryPath(const std::string& name);
+
+    // plugins/bin is a symlink to the current generation, a directory of hard links into the
+    // content-addressed store. Generations are never changed once created.
+    std::optional<u64> getCurrentGeneration();
+
+    // Create a generation from the current one, with the staged binaries of these plugins in and
+    // the removed plugins out, and switch to it with a single rename
+    hyprload::Result<std::monostate, std::string>
+    commitBinaries(const std::vector<std::string>& staged,
+                   const std::vector<std::string>& removed = {});
+
+    // Switch back to the generation before the current one, discarding the current one
+    hyprload::Result<u64, std::string> rollback();
+
+    // Remove generations past the configured count or age, then binaries none of them use
+    void collectGenerations();
+    // Have the janitor finish removing generations an earlier one was stopped in the middle of
+    void collectRemovedGenerations();
+}
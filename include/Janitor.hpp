@@ -0,0 +1,46 @@
+#pragma once
+#include "types.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace hyprload {
+    // Removes stale sessions, old generations and other leftovers on its own thread. Trees are
+    // unlinked through directory fds a batch at a time, with a pause between batches, so neither
+    // the compositor nor the disk are held up by a large cleanup.
+    class Janitor final {
+      public:
+        Janitor();
+        // Stops after the current batch, whatever is left is found again on the next start
+        ~Janitor();
+
+        Janitor(const Janitor&) = delete;
+        Janitor& operator=(const Janitor&) = delete;
+
+        void removeTree(const std::filesystem::path& path);
+        // Remove the sessions no running instance holds the lock of, except the current one
+        void removeStaleSessions(const std::optional<std::filesystem::path>& currentSession);
+        void submit(std::function<void()>&& task);
+
+      private:
+        void run();
+        void removeContents(fd_t directoryFd);
+        bool removeEntry(fd_t directoryFd, const char* name, bool isDirectory);
+
+        std::thread m_tThread;
+        std::mutex m_mMutex;
+        std::condition_variable m_cvTasks;
+        std::deque<std::function<void()>> m_dTasks;
+        std::atomic<bool> m_bStopping = false;
+        usize m_iBatchRemoved = 0;
+    };
+
+    inline std::unique_ptr<Janitor> g_pJanitor;
+}
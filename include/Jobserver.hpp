@@ -0,0 +1,43 @@
+#pragma once
+#include "types.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <spawn.h>
+
+namespace hyprload {
+    // A GNU make jobserver shared by every build hyprload runs. Each build already holds one
+    // implicit slot, so the pool only holds the tokens left over after the concurrent builds.
+    // The FIFO form is also what ninja looks for in MAKEFLAGS, older makes get the pipe fds.
+    class Jobserver final {
+      public:
+        Jobserver(const std::filesystem::path& fifoPath, usize slots, usize concurrentBuilds);
+        ~Jobserver();
+
+        Jobserver(const Jobserver&) = delete;
+        Jobserver& operator=(const Jobserver&) = delete;
+
+        bool isValid() const;
+        // Makes older than 4.4 only take the jobserver as inherited fds, which these actions
+        // give the spawned process
+        void inheritFds(posix_spawn_file_actions_t* actions) const;
+        usize getSlots() const;
+        const std::string& getMakeflags() const;
+
+      private:
+        std::filesystem::path m_pFifoPath;
+        fd_t m_iReadFd = -1;
+        fd_t m_iWriteFd = -1;
+        fd_t m_iInheritedReadFd = -1;
+        fd_t m_iInheritedWriteFd = -1;
+        usize m_iSlots;
+        std::string m_sMakeflags;
+    };
+
+    // Shell prefix that exports the jobserver to a build command, empty if there is none
+    std::string getJobserverExports();
+
+    inline std::unique_ptr<Jobserver> g_pJobserver;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "types.hpp"
+#include "HyprloadPlugin.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace hyprload::lock {
+    // What a plugin was last successfully installed from
+    struct SLockedPlugin {
+        std::string m_sSource;
+        std::optional<std::string> m_sRevision;
+        std::string m_sManifestHash;
+        std::string m_sBinaryHash;
+        std::string m_sHyprlandCommit;
+    };
+
+    // hyprload.lock, next to hyprload.toml, so it can be shared along with it
+    std::filesystem::path getLockfilePath();
+
+    std::optional<SLockedPlugin> findPlugin(const std::string& name);
+    // The revision a source was locked at, if all the plugins built from it agree on one
+    std::optional<std::string> findSourceRevision(const std::string& identifier);
+
+    // Remember what the plugin was just deployed from, until its binary is committed
+    void stagePlugin(const std::string& name, const plugin::PluginSource& source);
+    // Lock the committed plugins to what they were staged from and their installed binaries,
+    // and drop the plugins that are no longer required
+    void commitPlugins(const std::vector<std::string>& committed,
+                       const std::vector<plugin::PluginRequirement>& requirements);
+    // Lock the plugins to the binaries installed after a rollback
+    void restorePlugins();
+}
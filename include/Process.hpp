@@ -0,0 +1,71 @@
+#pragma once
+#include "types.hpp"
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <variant>
+
+#include <sys/types.h>
+
+namespace hyprload {
+    struct SProcessResult {
+        // The exit status, or 128 + the signal that killed the process
+        int m_iExitCode = -1;
+        std::string m_sStdout;
+        std::string m_sStderr;
+        bool m_bTimedOut = false;
+        bool m_bCancelled = false;
+    };
+
+    // A shell command in its own process group, with stdout and stderr read through
+    // non-blocking pipes. The pidfd (when the kernel has them) becomes readable on exit, so the
+    // process can be waited on alongside other fds. Only builds are given the jobserver fds.
+    class Process final {
+      public:
+        Process(const std::string& command, bool inheritJobserver = false);
+        ~Process();
+
+        Process(const Process&) = delete;
+        Process& operator=(const Process&) = delete;
+
+        [[nodiscard]] hyprload::Result<std::monostate, std::string> start();
+
+        // Read whatever output is available and reap the process if it exited, never blocks.
+        // Returns true once the process has exited.
+        bool poll();
+
+        // Block until the process exits, the timeout passes, or processes get cancelled.
+        // The process group is killed in the latter two cases.
+        SProcessResult wait(std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+        void kill(int signal);
+
+        pid_t getPid() const;
+        fd_t getPidfd() const;
+
+      private:
+        void readOutput();
+        void closePipes();
+        bool reap(bool block);
+        void terminate();
+
+        std::string m_sCommand;
+        bool m_bInheritJobserver = false;
+
+        pid_t m_iPid = -1;
+        fd_t m_iPidfd = -1;
+        fd_t m_iStdoutFd = -1;
+        fd_t m_iStderrFd = -1;
+
+        bool m_bExited = false;
+        SProcessResult m_sResult;
+    };
+
+    // Kill every running process and refuse to start new ones, used when hyprload unloads
+    void cancelAllProcesses();
+
+    SProcessResult runCommand(const std::string& command,
+                              std::optional<std::chrono::milliseconds> timeout = std::nullopt,
+                              bool inheritJobserver = false);
+}
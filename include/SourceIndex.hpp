@@ -0,0 +1,23 @@
+#pragma once
+#include "types.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace hyprload::index {
+    // A hash of the path, size, mtime and inode of every file in the source tree, along with the
+    // Hyprland commit plugins get built against. In git worktrees, files ignored by git are left
+    // out, so build output that is ignored doesn't count as a change.
+    std::optional<std::string> getSourceFingerprint(const std::filesystem::path& sourcePath);
+
+    // Whether each of these plugins was last built from the tree as it is now. One that was
+    // never built from it counts as changed.
+    bool isSourceUnchanged(const std::filesystem::path& sourcePath,
+                           const std::vector<std::string>& names);
+
+    // Remember what the plugin was built from, or that its last build failed if nullopt
+    void recordBuild(const std::filesystem::path& sourcePath, const std::string& name,
+                     const std::optional<std::string>& fingerprint);
+}
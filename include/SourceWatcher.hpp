@@ -0,0 +1,59 @@
+#pragma once
+#include "types.hpp"
+#include "HyprloadPlugin.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct wl_event_source;
+
+namespace hyprload {
+    // Watches the trees of local plugin sources, and once writes to one of them settle, rebuilds
+    // the plugins it provides. The reload after the build only swaps those plugins.
+    class SourceWatcher final {
+      public:
+        SourceWatcher();
+        ~SourceWatcher();
+
+        SourceWatcher(const SourceWatcher&) = delete;
+        SourceWatcher& operator=(const SourceWatcher&) = delete;
+
+        // Watch the local sources of these requirements instead of the previous ones
+        void watch(const std::vector<plugin::PluginRequirement>& requirements);
+
+        // Called once builds finish. They write their own output into the source trees, so
+        // only the other changes seen during them schedule a rebuild.
+        void finishBuild();
+
+      private:
+        struct SWatchedSource {
+            std::filesystem::path m_pPath;
+            std::vector<plugin::PluginRequirement> m_vRequirements;
+            bool m_bChanged = false;
+            // Paths written during the running build, and during the one before it
+            std::unordered_set<std::string> m_sBuildPaths = {};
+            std::unordered_set<std::string> m_sLastBuildPaths = {};
+        };
+
+        static int onEvents(fd_t fd, u32 mask, void* data);
+        static int onSettled(void* data);
+
+        void addWatches(const std::filesystem::path& directory, usize source);
+        void readEvents(bool building);
+        void rebuildChanged();
+
+        fd_t m_iInotifyFd = -1;
+        wl_event_source* m_pEventSource = nullptr;
+        wl_event_source* m_pSettleTimer = nullptr;
+
+        std::vector<SWatchedSource> m_vSources;
+        // Watch descriptors to the source and directory they watch
+        std::unordered_map<int, std::pair<usize, std::filesystem::path>> m_mWatches;
+    };
+
+    inline std::unique_ptr<SourceWatcher> g_pSourceWatcher;
+}
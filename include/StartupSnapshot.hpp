@@ -0,0 +1,21 @@
+#pragma once
+#include "types.hpp"
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hyprload::snapshot {
+    // What the last start discovered, keyed by hyprload.toml and the current plugin binaries
+    struct SStartupSnapshot {
+        std::vector<std::string> m_vPlugins;
+        // Lazy plugins to the dispatchers they declare
+        std::unordered_map<std::string, std::vector<std::string>> m_mLazyDispatchers;
+    };
+
+    // The snapshot, if neither the config nor the binaries changed since it was written
+    std::optional<SStartupSnapshot> readSnapshot();
+
+    void writeSnapshot(const SStartupSnapshot& snapshot);
+}
@@ -1,8 +1,11 @@
 #pragma once
 #include "types.hpp"
 
+#include <chrono>
 #include <filesystem>
 #include <optional>
+#include <string>
+#include <variant>
 
 #include <hyprland/src/helpers/Color.hpp>
 
@@ -14,18 +17,45 @@ namespace hyprload {
     const std::string c_hyprlandHeaders = "plugin:hyprload:hyprland_headers";
     const std::string c_pluginQuiet = "plugin:hyprload:quiet";
     const std::string c_pluginDebug = "plugin:hyprload:debug";
+    const std::string c_pluginJobs = "plugin:hyprload:jobs";
+    const std::string c_pluginCompileJobs = "plugin:hyprload:compile_jobs";
+    const std::string c_pluginFullHeaderBuild = "plugin:hyprload:full_header_build";
+    const std::string c_pluginGitMirrors = "plugin:hyprload:git_mirrors";
+    const std::string c_pluginNetworkTimeout = "plugin:hyprload:network_timeout";
+    const std::string c_pluginWatch = "plugin:hyprload:watch";
+    const std::string c_pluginRemoteCheckTtl = "plugin:hyprload:remote_check_ttl";
+    const std::string c_pluginArtifactStore = "plugin:hyprload:artifact_store";
+    const std::string c_pluginGenerations = "plugin:hyprload:generations";
+    const std::string c_pluginGenerationMaxAge = "plugin:hyprload:generation_max_age";
 
     std::filesystem::path getRootPath();
     std::optional<std::filesystem::path> getConfigHyprlandHeadersPath();
     std::optional<std::filesystem::path> getHyprlandInstallationPath();
     std::filesystem::path getHyprlandHeadersPath();
+    std::filesystem::path getHyprlandHeadersStampPath();
     std::filesystem::path getPkgConfigOverridePath();
     std::filesystem::path getHyprlandPkgConfigPath();
     std::filesystem::path getPluginsPath();
     std::filesystem::path getPluginBinariesPath();
+    std::filesystem::path getPluginMirrorsPath();
+    std::filesystem::path getPluginStagingPath();
+    std::filesystem::path getPluginStorePath();
+    std::filesystem::path getPluginGenerationsPath();
+    std::filesystem::path getBuildCachePath();
+    std::filesystem::path getSourceIndexPath();
 
     bool isQuiet();
     bool isDebug();
+    usize getBuildJobCount();
+    usize getCompileJobCount();
+    bool isFullHeaderBuild();
+    bool isGitMirrorsEnabled();
+    std::optional<std::chrono::seconds> getNetworkTimeout();
+    bool isWatchEnabled();
+    std::chrono::seconds getRemoteCheckTtl();
+    std::optional<std::string> getArtifactStoreUrl();
+    usize getGenerationsToKeep();
+    std::optional<std::chrono::hours> getGenerationMaxAge();
 
     void info(const std::string& message, usize duration = 5000);
     void success(const std::string& message, usize duration = 5000);
@@ -36,5 +66,15 @@ namespace hyprload {
     std::optional<flock_t> tryGetLock(const std::filesystem::path& path);
     void releaseLock(flock_t lock);
 
-    std::tuple<int, std::string> executeCommand(const std::string& command);
+    // Make target a copy of source as cheaply as the filesystem allows: a reflink, then a hard
+    // link if the two may share an inode, then a copy that only appears at target once complete
+    hyprload::Result<std::monostate, std::string> stageFile(const std::filesystem::path& source,
+                                                            const std::filesystem::path& target,
+                                                            bool shareInode);
+
+    // Builds inherit the jobserver, which make only takes as fds before 4.4
+    std::tuple<int, std::string>
+    executeCommand(const std::string& command,
+                   std::optional<std::chrono::seconds> timeout = std::nullopt,
+                   bool inheritJobserver = false);
 }
@@ -0,0 +1,287 @@
+#include "ArtifactStore.hpp"
+#include "BuildCache.hpp"
+#include "Hash.hpp"
+#include "Hyprload.hpp"
+#include "Lockfile.hpp"
+#include "util.hpp"
+
+#include "toml/toml.hpp"
+
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+namespace hyprload::artifact {
+    static bool isRemoteStore(const std::string& store) {
+        return store.starts_with("http://") || store.starts_with("https://");
+    }
+
+    static std::filesystem::path getStoreDirectory(const std::string& store) {
+        return store.starts_with("file://") ? store.substr(7) : store;
+    }
+
+    static std::filesystem::path getTemporaryPath(const std::filesystem::path& path) {
+        std::filesystem::path temporary = path;
+        temporary += ".tmp." + std::to_string(getpid()) + "." +
+            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+        return temporary;
+    }
+
+    static std::string getCompilerVersion() {
+        static std::once_flag once;
+        static std::string version;
+
+        std::call_once(once, []() {
+            auto [exit, output] = executeCommand("${CXX:-c++} --version");
+
+            if (exit == 0) {
+                version = output.substr(0, output.find('\n'));
+            }
+        });
+
+        return version;
+    }
+
+    // A binary is only used if its record says it is the one published, for this Hyprland
+    static hyprload::Result<std::monostate, std::string>
+    verifyArtifact(const std::filesystem::path& artifact, const std::filesystem::path& metadata) {
+        toml::table record;
+
+        try {
+            record = toml::parse_file(metadata.string());
+        } catch (const std::exception& e) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to parse artifact record: " + std::string(e.what()));
+        }
+
+        std::string hyprlandCommit = record["hyprland"].value_or(std::string());
+
+        if (hyprlandCommit != g_pHyprload->getCurrentHyprlandCommitHash()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Artifact was built for Hyprland " + hyprlandCommit);
+        }
+
+        std::optional<std::string> digest = hash::sha256File(artifact);
+
+        if (!digest.has_value() || digest != record["digest"].value<std::string>()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Artifact does not match the digest it was published with");
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    static std::filesystem::path getArtifactPath(const std::string& name,
+                                                 const std::string& revision,
+                                                 const std::string& hyprlandCommit) {
+        return std::filesystem::path(name) / revision / (hyprlandCommit + ".so");
+    }
+
+    std::filesystem::path getArtifactPath(const std::string& name, const std::string& revision) {
+        return getArtifactPath(name, revision, g_pHyprload->getCurrentHyprlandCommitHash());
+    }
+
+    hyprload::Result<std::monostate, std::string> fetchArtifact(const std::string& name,
+                                                                const std::string& revision,
+                                                                const std::string& cacheKey) {
+        std::optional<std::string> store = getArtifactStoreUrl();
+
+        if (!store.has_value()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "No artifact store configured");
+        }
+
+        std::string artifactPath = getArtifactPath(name, revision).string();
+
+        if (!isRemoteStore(store.value())) {
+            std::filesystem::path artifact = getStoreDirectory(store.value()) / artifactPath;
+
+            if (!std::filesystem::exists(artifact)) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "No prebuilt binary for " + name + " at " + artifact.string());
+            }
+
+            std::filesystem::path metadata = artifact;
+            metadata.replace_extension(".toml");
+
+            auto verified = verifyArtifact(artifact, metadata);
+
+            if (verified.isErr()) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Rejected prebuilt binary for " + name + ": " + verified.unwrapErr());
+            }
+
+            return cache::storeArtifact(cacheKey, artifact);
+        }
+
+        std::string url = store.value();
+
+        if (!url.ends_with("/")) {
+            url += "/";
+        }
+
+        url += artifactPath;
+
+        std::string metadataUrl = url.substr(0, url.size() - 3) + ".toml";
+
+        std::filesystem::path cachePath = getBuildCachePath();
+        std::filesystem::path temporary = getTemporaryPath(cachePath / (cacheKey + ".so.fetch"));
+        std::filesystem::path temporaryMetadata =
+            getTemporaryPath(cachePath / (cacheKey + ".toml.fetch"));
+
+        std::error_code ec;
+        std::filesystem::create_directories(cachePath, ec);
+
+        // -f turns a missing artifact into a failure instead of saving the error page
+        auto [exit, output] =
+            executeCommand("curl -fsSL -o " + temporary.string() + " " + url +
+                               " && curl -fsSL -o " + temporaryMetadata.string() + " " +
+                               metadataUrl,
+                           getNetworkTimeout());
+
+        if (exit != 0) {
+            std::filesystem::remove(temporary, ec);
+            std::filesystem::remove(temporaryMetadata, ec);
+            return hyprload::Result<std::monostate, std::string>::err(
+                "No prebuilt binary for " + name + " at " + url + ": " + output);
+        }
+
+        auto verified = verifyArtifact(temporary, temporaryMetadata);
+        std::filesystem::remove(temporaryMetadata, ec);
+
+        if (verified.isErr()) {
+            std::filesystem::remove(temporary, ec);
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Rejected prebuilt binary for " + name + " from " + url + ": " +
+                verified.unwrapErr());
+        }
+
+        auto result = cache::storeArtifact(cacheKey, temporary);
+        std::filesystem::remove(temporary, ec);
+
+        return result;
+    }
+
+    hyprload::Result<std::monostate, std::string>
+    publishArtifact(const std::string& name, const plugin::PluginSource& source) {
+        std::optional<std::string> store = getArtifactStoreUrl();
+
+        if (!store.has_value() || isRemoteStore(store.value())) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Artifacts can only be published to a directory");
+        }
+
+        // The lockfile knows what the installed binary was built from, the checkout may have moved
+        std::optional<lock::SLockedPlugin> locked = lock::findPlugin(name);
+
+        if (!locked.has_value()) {
+            return hyprload::Result<std::monostate, std::string>::err(name + " is not locked");
+        }
+
+        if (!locked->m_sRevision.has_value()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                name + " is not built from a revision, so it can't be looked up");
+        }
+
+        auto pluginManifestResult = plugin::getPluginManifest(source.getSourcePath(), name);
+
+        if (pluginManifestResult.isErr()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                pluginManifestResult.unwrapErr());
+        }
+
+        std::filesystem::path binary = getPluginBinariesPath() / (name + ".so");
+        std::optional<std::string> digest = hash::sha256File(binary);
+
+        if (!digest.has_value()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                name + " is not installed");
+        }
+
+        if (digest.value() != locked->m_sBinaryHash) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "The installed binary of " + name + " is not the one locked");
+        }
+
+        // The build steps are recorded from the checkout, which has to be the one built
+        if (hash::sha256File(source.getSourcePath() / "hyprload.toml").value_or("") !=
+            locked->m_sManifestHash) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "The manifest of " + name + " changed since it was installed");
+        }
+
+        std::filesystem::path storePath = getStoreDirectory(store.value());
+        std::filesystem::path blob = storePath / "blobs" / (digest.value() + ".so");
+        std::filesystem::path artifact =
+            storePath /
+            getArtifactPath(name, locked->m_sRevision.value(), locked->m_sHyprlandCommit);
+
+        std::error_code ec;
+        std::filesystem::create_directories(blob.parent_path(), ec);
+        std::filesystem::create_directories(artifact.parent_path(), ec);
+
+        // Identical builds from several machines share one blob
+        if (!std::filesystem::exists(blob)) {
+            std::filesystem::path temporary = getTemporaryPath(blob);
+            auto result = stageFile(binary, temporary, false);
+
+            if (result.isErr()) {
+                return result;
+            }
+
+            std::filesystem::rename(temporary, blob, ec);
+
+            if (ec) {
+                std::filesystem::remove(temporary, ec);
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to publish " + name + ": " + ec.message());
+            }
+        }
+
+        toml::array buildSteps;
+
+        for (const auto& step : pluginManifestResult.unwrap()->getBuildSteps()) {
+            buildSteps.push_back(step);
+        }
+
+        toml::table metadata = toml::table{
+            {"plugin", name},
+            {"revision", locked->m_sRevision.value()},
+            {"hyprland", locked->m_sHyprlandCommit},
+            {"compiler", getCompilerVersion()},
+            {"build", std::move(buildSteps)},
+            {"digest", digest.value()},
+        };
+
+        std::filesystem::path metadataPath = artifact;
+        metadataPath.replace_extension(".toml");
+
+        std::filesystem::path temporaryMetadata = getTemporaryPath(metadataPath);
+        std::ofstream metadataFile(temporaryMetadata);
+        metadataFile << metadata << "\n";
+        metadataFile.close();
+
+        std::filesystem::rename(temporaryMetadata, metadataPath, ec);
+
+        // Replacing rather than writing, so a machine fetching it never sees half a binary
+        std::filesystem::path temporary = getTemporaryPath(artifact);
+        auto result = stageFile(blob, temporary, true);
+
+        if (result.isErr()) {
+            return result;
+        }
+
+        std::filesystem::rename(temporary, artifact, ec);
+
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to publish " + name + ": " + ec.message());
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+}
@@ -0,0 +1,97 @@
+#include "BuildCache.hpp"
+#include "Hash.hpp"
+#include "util.hpp"
+
+#include <unistd.h>
+
+#include <thread>
+
+namespace hyprload::cache {
+    std::string getCacheKey(const SBuildInputs& inputs) {
+        hash::Sha256 hasher;
+
+        // Length-prefix every field so they can't run into each other
+        auto field = [&hasher](std::string_view value) {
+            hasher.update(std::to_string(value.size()) + ":");
+            hasher.update(value);
+        };
+
+        field(inputs.m_sName);
+        field(inputs.m_sRevision);
+
+        for (const auto& step : inputs.m_vBuildSteps) {
+            field(step);
+        }
+
+        field(inputs.m_pBinaryOutputPath.string());
+        field(inputs.m_sHyprlandCommit);
+
+        return hasher.finish();
+    }
+
+    std::optional<std::filesystem::path> findArtifact(const std::string& key) {
+        std::filesystem::path artifact = getBuildCachePath() / (key + ".so");
+
+        if (!std::filesystem::exists(artifact)) {
+            return std::nullopt;
+        }
+
+        return artifact;
+    }
+
+    hyprload::Result<std::monostate, std::string>
+    storeArtifact(const std::string& key, const std::filesystem::path& binary) {
+        std::filesystem::path cachePath = getBuildCachePath();
+        std::filesystem::path artifact = cachePath / (key + ".so");
+        std::filesystem::path temporary =
+            cachePath / (key + ".so.tmp." + std::to_string(getpid()) + "." +
+                         std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())));
+
+        std::error_code ec;
+        std::filesystem::create_directories(cachePath, ec);
+
+        // The build output gets rebuilt in place, so it can't share an inode with the cache
+        auto result = stageFile(binary, temporary, false);
+
+        if (result.isErr()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to copy binary to the build cache: " + result.unwrapErr());
+        }
+
+        // Cached binaries get hard linked around, nothing should write through them
+        std::filesystem::permissions(temporary,
+                                     std::filesystem::perms::owner_read |
+                                         std::filesystem::perms::group_read |
+                                         std::filesystem::perms::others_read,
+                                     ec);
+
+        std::filesystem::rename(temporary, artifact, ec);
+
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to store binary in the build cache: " + ec.message());
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    hyprload::Result<std::monostate, std::string>
+    restoreArtifact(const std::string& key, const std::filesystem::path& target) {
+        std::optional<std::filesystem::path> artifact = findArtifact(key);
+
+        if (!artifact.has_value()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Binary is not in the build cache");
+        }
+
+        auto result = stageFile(artifact.value(), target, true);
+
+        if (result.isErr()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to restore binary from the build cache: " + result.unwrapErr());
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+}
@@ -0,0 +1,46 @@
+#include "BuildGraph.hpp"
+
+namespace hyprload {
+    BuildNode::BuildNode(std::string&& key, BuildWork&& work, eBuildPriority priority) {
+        m_sKey = std::move(key);
+        m_fWork = std::move(work);
+        m_ePriority = priority;
+    }
+
+    void BuildNode::dependOn(const std::shared_ptr<BuildNode>& dependency) {
+        if (!dependency) {
+            return;
+        }
+
+        dependency->m_vDependents.push_back(shared_from_this());
+        m_iPendingDependencies++;
+    }
+
+    void BuildNode::report(const std::shared_ptr<BuildProcessDescriptor>& descriptor) {
+        m_vDescriptors.push_back(descriptor);
+    }
+
+    std::shared_ptr<BuildNode> BuildGraph::findNode(const std::string& key) const {
+        auto it = m_mNodesByKey.find(key);
+
+        if (it == m_mNodesByKey.end()) {
+            return nullptr;
+        }
+
+        return it->second;
+    }
+
+    std::shared_ptr<BuildNode> BuildGraph::addNode(std::string&& key, BuildWork&& work,
+                                                   eBuildPriority priority) {
+        auto node = std::make_shared<BuildNode>(std::string(key), std::move(work), priority);
+
+        m_mNodesByKey[key] = node;
+        m_vNodes.push_back(node);
+
+        return node;
+    }
+
+    const std::vector<std::shared_ptr<BuildNode>>& BuildGraph::getNodes() const {
+        return m_vNodes;
+    }
+}
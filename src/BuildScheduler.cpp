@@ -0,0 +1,149 @@
+#include "BuildScheduler.hpp"
+#include "util.hpp"
+
+#include <exception>
+
+namespace hyprload {
+    bool BuildScheduler::SQueuedNode::operator<(const SQueuedNode& other) const {
+        if (m_pNode->m_ePriority != other.m_pNode->m_ePriority) {
+            return m_pNode->m_ePriority < other.m_pNode->m_ePriority;
+        }
+
+        // Earlier nodes come out of the queue first
+        return m_iSequence > other.m_iSequence;
+    }
+
+    BuildScheduler::BuildScheduler(usize jobs, std::function<void()>&& onReport) {
+        m_iJobCount = jobs > 0 ? jobs : 1;
+        m_fOnReport = std::move(onReport);
+
+        for (usize i = 0; i < m_iJobCount; i++) {
+            m_vWorkers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    BuildScheduler::~BuildScheduler() {
+        shutdown();
+    }
+
+    void BuildScheduler::submit(const BuildGraph& graph) {
+        {
+            auto lock = std::scoped_lock<std::mutex>(m_mMutex);
+
+            if (m_bShuttingDown) {
+                return;
+            }
+
+            for (const auto& node : graph.getNodes()) {
+                if (node->m_iPendingDependencies == 0) {
+                    enqueue(node);
+                }
+            }
+        }
+
+        m_cvJobs.notify_all();
+    }
+
+    void BuildScheduler::shutdown() {
+        {
+            auto lock = std::scoped_lock<std::mutex>(m_mMutex);
+
+            if (m_bShuttingDown) {
+                return;
+            }
+
+            m_bShuttingDown = true;
+            m_qJobs = std::priority_queue<SQueuedNode>();
+        }
+
+        m_cvJobs.notify_all();
+
+        for (auto& worker : m_vWorkers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+
+        m_vWorkers.clear();
+    }
+
+    usize BuildScheduler::getJobCount() const {
+        return m_iJobCount;
+    }
+
+    void BuildScheduler::enqueue(const std::shared_ptr<BuildNode>& node) {
+        m_qJobs.push(SQueuedNode{
+            .m_pNode = node,
+            .m_iSequence = m_iNextSequence++,
+        });
+    }
+
+    void BuildScheduler::finish(const std::shared_ptr<BuildNode>& node,
+                                hyprload::Result<std::monostate, std::string>&& result) {
+        node->m_rResult = std::move(result);
+
+        for (const auto& descriptor : node->m_vDescriptors) {
+            auto descriptorLock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+
+            descriptor->m_rResult = node->m_rResult;
+        }
+
+        if (!node->m_vDescriptors.empty() && m_fOnReport) {
+            m_fOnReport();
+        }
+
+        for (const auto& dependent : node->m_vDependents) {
+            if (dependent->m_rResult.has_value()) {
+                continue;
+            }
+
+            if (node->m_rResult.value().isErr()) {
+                finish(dependent,
+                       hyprload::Result<std::monostate, std::string>::err(
+                           node->m_rResult.value().unwrapErr()));
+            } else if (--dependent->m_iPendingDependencies == 0) {
+                enqueue(dependent);
+            }
+        }
+
+        // Drop the edges, so nothing keeps finished parts of the graph alive
+        node->m_vDependents.clear();
+        node->m_fWork = nullptr;
+    }
+
+    void BuildScheduler::workerLoop() {
+        while (true) {
+            std::unique_lock<std::mutex> lock = std::unique_lock(m_mMutex);
+            m_cvJobs.wait(lock, [this]() { return m_bShuttingDown || !m_qJobs.empty(); });
+
+            if (m_bShuttingDown) {
+                return;
+            }
+
+            std::shared_ptr<BuildNode> node = m_qJobs.top().m_pNode;
+            m_qJobs.pop();
+            lock.unlock();
+
+            std::optional<hyprload::Result<std::monostate, std::string>> result;
+
+            try {
+                result = node->m_fWork();
+            } catch (const std::exception& e) {
+                result = hyprload::Result<std::monostate, std::string>::err(
+                    "Build step " + node->m_sKey + " failed: " + std::string(e.what()));
+            }
+
+            lock.lock();
+
+            usize queued = m_qJobs.size();
+            finish(node, std::move(result.value()));
+            usize released = m_qJobs.size() - queued;
+
+            lock.unlock();
+
+            for (usize i = 0; i < released; i++) {
+                m_cvJobs.notify_one();
+            }
+        }
+    }
+}
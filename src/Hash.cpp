@@ -0,0 +1,157 @@
+#include "Hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace hyprload::hash {
+    constexpr std::array<u32, 64> c_roundConstants = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+        0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+        0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+        0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+        0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+        0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+        0xc67178f2,
+    };
+
+    static u32 rotateRight(u32 value, u32 bits) {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    Sha256::Sha256() {
+        m_aState = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    }
+
+    void Sha256::transform(const u8* block) {
+        std::array<u32, 64> schedule;
+
+        for (usize i = 0; i < 16; i++) {
+            schedule[i] = (u32(block[i * 4]) << 24) | (u32(block[i * 4 + 1]) << 16) |
+                (u32(block[i * 4 + 2]) << 8) | u32(block[i * 4 + 3]);
+        }
+
+        for (usize i = 16; i < 64; i++) {
+            u32 s0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^
+                (schedule[i - 15] >> 3);
+            u32 s1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^
+                (schedule[i - 2] >> 10);
+            schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+        }
+
+        u32 a = m_aState[0], b = m_aState[1], c = m_aState[2], d = m_aState[3];
+        u32 e = m_aState[4], f = m_aState[5], g = m_aState[6], h = m_aState[7];
+
+        for (usize i = 0; i < 64; i++) {
+            u32 s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            u32 choice = (e & f) ^ (~e & g);
+            u32 temp1 = h + s1 + choice + c_roundConstants[i] + schedule[i];
+            u32 s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            u32 majority = (a & b) ^ (a & c) ^ (b & c);
+            u32 temp2 = s0 + majority;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+
+        m_aState[0] += a;
+        m_aState[1] += b;
+        m_aState[2] += c;
+        m_aState[3] += d;
+        m_aState[4] += e;
+        m_aState[5] += f;
+        m_aState[6] += g;
+        m_aState[7] += h;
+    }
+
+    void Sha256::update(const void* data, usize length) {
+        const u8* bytes = static_cast<const u8*>(data);
+        m_iTotalLength += length;
+
+        while (length > 0) {
+            usize chunk = std::min(length, m_aBuffer.size() - m_iBufferLength);
+            std::memcpy(m_aBuffer.data() + m_iBufferLength, bytes, chunk);
+
+            m_iBufferLength += chunk;
+            bytes += chunk;
+            length -= chunk;
+
+            if (m_iBufferLength == m_aBuffer.size()) {
+                transform(m_aBuffer.data());
+                m_iBufferLength = 0;
+            }
+        }
+    }
+
+    void Sha256::update(std::string_view data) {
+        update(data.data(), data.size());
+    }
+
+    std::string Sha256::finish() {
+        u64 totalBits = m_iTotalLength * 8;
+
+        u8 padding = 0x80;
+        update(&padding, 1);
+
+        padding = 0;
+        while (m_iBufferLength != 56) {
+            update(&padding, 1);
+        }
+
+        u8 length[8];
+        for (usize i = 0; i < 8; i++) {
+            length[i] = u8(totalBits >> (56 - i * 8));
+        }
+        update(length, 8);
+
+        static const char* hex = "0123456789abcdef";
+        std::string digest;
+        digest.reserve(64);
+
+        for (u32 word : m_aState) {
+            for (i32 shift = 28; shift >= 0; shift -= 4) {
+                digest += hex[(word >> shift) & 0xf];
+            }
+        }
+
+        return digest;
+    }
+
+    std::string sha256(std::string_view data) {
+        Sha256 hasher;
+        hasher.update(data);
+        return hasher.finish();
+    }
+
+    std::optional<std::string> sha256File(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file.is_open()) {
+            return std::nullopt;
+        }
+
+        Sha256 hasher;
+        std::array<char, 65536> buffer;
+
+        while (file) {
+            file.read(buffer.data(), buffer.size());
+            hasher.update(buffer.data(), file.gcount());
+        }
+
+        if (file.bad()) {
+            return std::nullopt;
+        }
+
+        return hasher.finish();
+    }
+}
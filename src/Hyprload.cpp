@@ -4,58 +4,112 @@
 
 #include "Hyprload.hpp"
 #include "HyprloadConfig.hpp"
-
+#include "ArtifactStore.hpp"
+#include "InstallTransaction.hpp"
+#include "Janitor.hpp"
+#include "Jobserver.hpp"
+#include "Lockfile.hpp"
+#include "Process.hpp"
+#include "SourceWatcher.hpp"
+#include "StartupSnapshot.hpp"
+
+#include "toml/toml.hpp"
+
+#include <hyprland/src/Compositor.hpp>
+#include <hyprland/src/debug/Log.hpp>
 #include <hyprland/src/helpers/Monitor.hpp>
 #include <hyprland/src/plugins/PluginSystem.hpp>
 #include <hyprland/src/config/ConfigManager.hpp>
+#include <hyprland/src/managers/KeybindManager.hpp>
 #include <hyprland/src/plugins/PluginAPI.hpp>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <thread>
 #include <random>
-#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <wayland-server-core.h>
 #include <mutex>
 #include <variant>
 #include <vector>
 
 namespace hyprload {
-    std::mutex g_mSetupHeadersMutex;
-    std::condition_variable g_cvSetupHeaders;
-    std::optional<hyprload::Result<std::monostate, std::string>> g_bHeadersReady = std::nullopt;
-
     Hyprload::Hyprload() {
         m_sSessionGuid = std::nullopt;
         m_vPlugins = std::vector<std::string>();
         m_vBuildProcesses = std::vector<std::shared_ptr<hyprload::BuildProcessDescriptor>>();
     }
 
-    void Hyprload::handleTick() {
+    static int onBuildEvent(fd_t fd, u32, void* data) {
+        u64 count;
+
+        // One read drains every result reported since the last wakeup
+        if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+            static_cast<Hyprload*>(data)->handleBuildEvents();
+        }
+
+        return 0;
+    }
+
+    void Hyprload::handleBuildEvents() {
         if (!m_bIsBuilding) {
             return;
         }
 
-        auto buildProcesses = m_vBuildProcesses;
-        for (auto bp : buildProcesses) {
-            if (bp->m_mMutex.try_lock()) {
-                if (bp->m_rResult.has_value()) {
-                    if (bp->m_rResult.value().isErr()) {
-                        error(bp->m_rResult.value().unwrapErr());
-                    } else {
-                        success("Successfully updated " + bp->m_sName);
-                    }
-                    m_vBuildProcesses.erase(
-                        std::remove(m_vBuildProcesses.begin(), m_vBuildProcesses.end(), bp),
-                        m_vBuildProcesses.end());
-                    debug("Build processes left: " + std::to_string(m_vBuildProcesses.size()));
-                }
+        std::erase_if(m_vBuildProcesses, [this](const auto& bp) {
+            auto lock = std::scoped_lock<std::mutex>(bp->m_mMutex);
 
-                bp->m_mMutex.unlock();
+            if (!bp->m_rResult.has_value()) {
+                return false;
+            }
+
+            if (bp->m_rResult.value().isErr()) {
+                error(bp->m_rResult.value().unwrapErr());
+            } else {
+                success("Successfully updated " + bp->m_sName);
+
+                // hyprload installs itself, everything else was only staged
+                if (!std::dynamic_pointer_cast<plugin::SelfSource>(bp->m_pSource)) {
+                    m_vStagedPlugins.push_back(bp->m_sName);
+                }
             }
-        }
+
+            return true;
+        });
+
+        debug("Build processes left: " + std::to_string(m_vBuildProcesses.size()));
 
         if (m_vBuildProcesses.empty()) {
             m_bIsBuilding = false;
             success("Finished updating all plugins");
 
+            if (g_pSourceWatcher) {
+                g_pSourceWatcher->finishBuild();
+            }
+
+            std::vector<std::string> committed;
+
+            if (!m_vStagedPlugins.empty()) {
+                auto result = install::commitBinaries(m_vStagedPlugins);
+
+                if (result.isErr()) {
+                    error(result.unwrapErr());
+                } else {
+                    committed = std::move(m_vStagedPlugins);
+                }
+
+                m_vStagedPlugins.clear();
+            }
+
+            // Only locked once committed, a failed commit leaves the lockfile as it was
+            lock::commitPlugins(committed, config::g_pHyprloadConfig->getPlugins());
+
             reloadPlugins();
         }
     }
@@ -80,176 +134,304 @@ namespace hyprload {
         return true;
     }
 
-    void Hyprload::installPlugins() {
-        if (m_bIsBuilding) {
-            error("Already updating plugins");
-            return;
+    static std::shared_ptr<BuildNode>
+    addFetchNode(BuildGraph& graph, const std::shared_ptr<plugin::PluginSource>& source,
+                 eBuildPriority priority) {
+        std::string key = "fetch:" + source->getIdentifier();
+
+        if (auto node = graph.findNode(key)) {
+            return node;
         }
 
-        m_bIsBuilding = true;
+        return graph.addNode(
+            std::move(key),
+            [source]() {
+                if (source->isSourceAvailable()) {
+                    return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+                }
 
-        std::optional<std::filesystem::path> configHyprlandHeadersPath =
-            hyprload::getConfigHyprlandHeadersPath();
+                auto result = source->installSource();
 
-        if (!configHyprlandHeadersPath.has_value()) {
-            setupHeaders();
-        } else {
-            g_bHeadersReady = hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+                if (result.isErr()) {
+                    return hyprload::Result<std::monostate, std::string>::err(
+                        "Failed to install " + source->getIdentifier() +
+                        " source: " + result.unwrapErr());
+                }
+
+                return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+            },
+            priority);
+    }
+
+    static std::shared_ptr<BuildNode>
+    addSyncNode(BuildGraph& graph, const std::shared_ptr<plugin::PluginSource>& source,
+                bool forceUpdate, eBuildPriority priority) {
+        std::string key = "sync:" + source->getIdentifier();
+
+        if (auto node = graph.findNode(key)) {
+            return node;
         }
 
-        setupPkgConfig();
+        auto node = graph.addNode(
+            std::move(key),
+            [source, forceUpdate]() {
+                if (source->isUpToDate() && !forceUpdate) {
+                    return hyprload::Result<std::monostate, std::string>::err(
+                        "Source is up to date, skipping update...");
+                }
 
-        config::g_pHyprloadConfig->reloadConfig();
+                auto result = source->updateSource();
 
-        const std::vector<plugin::PluginRequirement>& requirements =
-            config::g_pHyprloadConfig->getPlugins();
+                if (result.isErr()) {
+                    return hyprload::Result<std::monostate, std::string>::err(
+                        "Failed to update " + source->getIdentifier() + ": " +
+                        result.unwrapErr());
+                }
 
-        for (const plugin::PluginRequirement& plugin : requirements) {
-            std::shared_ptr<hyprload::BuildProcessDescriptor> descriptor =
-                std::make_shared<hyprload::BuildProcessDescriptor>(std::string(plugin.getName()),
-                                                                   plugin.getSource());
+                return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+            },
+            priority);
 
-            auto myDescriptor = descriptor;
-            m_vBuildProcesses.push_back(myDescriptor);
+        node->dependOn(addFetchNode(graph, source, priority));
 
-            std::thread thread = std::thread([descriptor]() {
-                std::unique_lock<std::mutex> headerLock = std::unique_lock(g_mSetupHeadersMutex);
-                g_cvSetupHeaders.wait(headerLock, []() { return g_bHeadersReady.has_value(); });
+        return node;
+    }
 
-                if (g_bHeadersReady.value().isOk()) {
-                    headerLock.unlock();
-                } else {
-                    auto lock = std::unique_lock<std::mutex>(descriptor->m_mMutex);
+    // fetch -> (sync) -> build -> install, with the source steps shared between requirements
+    static void
+    addRequirementNodes(BuildGraph& graph,
+                        const std::shared_ptr<hyprload::BuildProcessDescriptor>& descriptor,
+                        const std::shared_ptr<BuildNode>& headersNode, bool update,
+                        bool forceUpdate, eBuildPriority priority) {
+        const std::string& name = descriptor->m_sName;
+        std::shared_ptr<plugin::PluginSource> source = descriptor->m_pSource;
 
-                    descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                        "Failed to setup Hyprland headers");
-                    return;
-                }
+        std::string installKey = "install:" + name;
 
-                auto source = descriptor->m_pSource;
+        if (auto installNode = graph.findNode(installKey)) {
+            installNode->report(descriptor);
+            return;
+        }
 
-                if (!source->isSourceAvailable()) {
-                    auto result = source->installSource();
+        std::shared_ptr<BuildNode> sourceNode = update
+            ? addSyncNode(graph, source, forceUpdate, priority)
+            : addFetchNode(graph, source, priority);
 
-                    if (result.isErr()) {
-                        auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+        auto buildNode = graph.addNode(
+            "build:" + source->getIdentifier() + ":" + name,
+            [source, name]() {
+                auto result = source->build(name);
 
-                        descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                            "Failed to install " + descriptor->m_sName +
-                            " source: " + result.unwrapErr());
-                        return;
-                    }
+                if (result.isErr()) {
+                    return hyprload::Result<std::monostate, std::string>::err(
+                        "Failed to build " + name + ": " + result.unwrapErr());
                 }
 
-                auto result = source->build(descriptor->m_sName);
+                return result;
+            },
+            priority);
+
+        buildNode->dependOn(headersNode);
+        buildNode->dependOn(sourceNode);
+
+        auto installNode = graph.addNode(
+            std::move(installKey),
+            [source, name]() {
+                auto result = source->deploy(name);
 
                 if (result.isErr()) {
-                    auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+                    return hyprload::Result<std::monostate, std::string>::err(
+                        "Failed to install " + name + ": " + result.unwrapErr());
+                }
 
-                    descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                        "Failed to build " + descriptor->m_sName + ": " + result.unwrapErr());
-                    return;
+                // hyprload itself isn't a plugin binary, and follows its own updates
+                if (!std::dynamic_pointer_cast<plugin::SelfSource>(source)) {
+                    lock::stagePlugin(name, *source);
                 }
 
-                auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+                return result;
+            },
+            priority);
 
-                descriptor->m_rResult =
-                    hyprload::Result<std::monostate, std::string>::ok(std::monostate());
-            });
+        installNode->dependOn(buildNode);
+        installNode->report(descriptor);
+    }
 
-            thread.detach();
+    void Hyprload::setupBuildScheduler() {
+        // Asks Hyprland, which only the compositor thread may do
+        getCurrentHyprlandCommitHash();
+
+        usize jobs = getBuildJobCount();
+        usize compileJobs = getCompileJobCount();
+
+        if (m_iBuildEventFd < 0) {
+            // Workers signal finished builds here, so the main thread only wakes up for them
+            m_iBuildEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            m_pBuildEventSource = wl_event_loop_add_fd(g_pCompositor->m_sWLEventLoop,
+                                                       m_iBuildEventFd, WL_EVENT_READABLE,
+                                                       onBuildEvent, this);
+        }
+
+        // Only called while nothing is building, so the old workers are idle
+        if (!m_pBuildScheduler || m_pBuildScheduler->getJobCount() != jobs) {
+            m_pBuildScheduler = nullptr;
+            m_pBuildScheduler = std::make_unique<hyprload::BuildScheduler>(
+                jobs, [fd = m_iBuildEventFd]() {
+                    u64 one = 1;
+                    ssize_t written;
+
+                    do {
+                        written = write(fd, &one, sizeof(one));
+                    } while (written < 0 && errno == EINTR);
+
+                    // EAGAIN means the counter is full, so the main thread is already woken up
+                    if (written < 0 && errno != EAGAIN) {
+                        // Called from the workers, which can't show notifications
+                        Debug::log(ERR, " [hyprload] Failed to signal finished build: {}",
+                                   strerror(errno));
+                    }
+                });
+
+            debug("Build scheduler running " + std::to_string(jobs) + " jobs");
+        }
+
+        if (!g_pJobserver || g_pJobserver->getSlots() != compileJobs) {
+            g_pJobserver = nullptr;
+            g_pJobserver = std::make_unique<hyprload::Jobserver>(
+                getRootPath() / ("jobserver." + std::to_string(getpid()) + ".fifo"), compileJobs,
+                jobs);
         }
     }
 
-    void Hyprload::updatePlugins() {
+    void Hyprload::shutdownBuildScheduler() {
+        // Running builds would otherwise keep the workers from joining until they finish
+        cancelAllProcesses();
+
+        if (m_pBuildScheduler) {
+            m_pBuildScheduler->shutdown();
+            m_pBuildScheduler = nullptr;
+        }
+
+        if (m_pBuildEventSource) {
+            wl_event_source_remove(m_pBuildEventSource);
+            m_pBuildEventSource = nullptr;
+        }
+
+        if (m_iBuildEventFd >= 0) {
+            close(m_iBuildEventFd);
+            m_iBuildEventFd = -1;
+        }
+
+        g_pJobserver = nullptr;
+    }
+
+    void Hyprload::installPlugins() {
         if (m_bIsBuilding) {
             error("Already updating plugins");
             return;
         }
 
-        info("Updating plugins...");
+        config::g_pHyprloadConfig->reloadConfig();
+
+        setupSourceWatcher();
+
+        buildPlugins(config::g_pHyprloadConfig->getPlugins());
+    }
+
+    void Hyprload::buildPlugins(const std::vector<plugin::PluginRequirement>& requirements) {
+        if (m_bIsBuilding) {
+            error("Already updating plugins");
+            return;
+        }
 
         m_bIsBuilding = true;
 
-        std::optional<std::filesystem::path> configHyprlandHeadersPath =
-            hyprload::getConfigHyprlandHeadersPath();
+        setupBuildScheduler();
 
-        if (!configHyprlandHeadersPath.has_value()) {
-            setupHeaders();
-        } else {
-            g_bHeadersReady = hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        BuildGraph graph;
+
+        std::shared_ptr<BuildNode> headersNode = nullptr;
+
+        if (!hyprload::getConfigHyprlandHeadersPath().has_value()) {
+            headersNode = setupHeaders(graph);
         }
 
         setupPkgConfig();
 
-        // update self
+        for (const plugin::PluginRequirement& plugin : requirements) {
+            std::shared_ptr<hyprload::BuildProcessDescriptor> descriptor =
+                std::make_shared<hyprload::BuildProcessDescriptor>(std::string(plugin.getName()),
+                                                                   plugin.getSource());
 
-        std::shared_ptr<hyprload::BuildProcessDescriptor> descriptor =
-            std::make_shared<hyprload::BuildProcessDescriptor>(
-                "hyprload", std::make_shared<plugin::SelfSource>());
+            m_vBuildProcesses.push_back(descriptor);
 
-        auto myDescriptor = descriptor;
-        m_vBuildProcesses.push_back(myDescriptor);
+            addRequirementNodes(graph, descriptor, headersNode, false, false,
+                                BUILD_PRIORITY_PLUGIN);
+        }
 
-        bool forceUpdate = !checkIfHyprloadFullyCompatible();
+        m_pBuildScheduler->submit(graph);
 
-        std::thread thread = std::thread([descriptor, forceUpdate]() {
-            std::unique_lock<std::mutex> headerLock = std::unique_lock(g_mSetupHeadersMutex);
-            g_cvSetupHeaders.wait(headerLock, []() { return g_bHeadersReady.has_value(); });
+        // Nothing will report in, so finish right away
+        if (m_vBuildProcesses.empty()) {
+            handleBuildEvents();
+        }
+    }
 
-            if (g_bHeadersReady.value().isOk()) {
-                headerLock.unlock();
-            } else {
-                auto lock = std::unique_lock<std::mutex>(descriptor->m_mMutex);
+    bool Hyprload::isBuilding() const {
+        return m_bIsBuilding;
+    }
 
-                descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to setup Hyprland headers");
-                return;
-            }
+    void Hyprload::setupSourceWatcher() {
+        if (!isWatchEnabled()) {
+            g_pSourceWatcher = nullptr;
+            return;
+        }
 
-            auto source = descriptor->m_pSource;
+        if (!g_pSourceWatcher) {
+            g_pSourceWatcher = std::make_unique<SourceWatcher>();
+        }
 
-            if (!source->isSourceAvailable()) {
-                auto result = source->installSource();
+        g_pSourceWatcher->watch(config::g_pHyprloadConfig->getPlugins());
+    }
 
-                if (result.isErr()) {
-                    auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+    void Hyprload::updatePlugins() {
+        if (m_bIsBuilding) {
+            error("Already updating plugins");
+            return;
+        }
 
-                    descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                        "Failed to install " + descriptor->m_sName +
-                        " source: " + result.unwrapErr());
-                    return;
-                }
-            }
+        info("Updating plugins...");
 
-            if (source->isUpToDate() && !forceUpdate) {
-                auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+        m_bIsBuilding = true;
 
-                descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                    "Source is up to date, skipping update...");
-                return;
-            }
+        setupBuildScheduler();
 
-            auto result = source->update(descriptor->m_sName);
+        BuildGraph graph;
 
-            if (result.isErr()) {
-                auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+        std::shared_ptr<BuildNode> headersNode = nullptr;
 
-                descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to build " + descriptor->m_sName + ": " + result.unwrapErr());
-                return;
-            }
+        if (!hyprload::getConfigHyprlandHeadersPath().has_value()) {
+            headersNode = setupHeaders(graph);
+        }
 
-            auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+        setupPkgConfig();
 
-            descriptor->m_rResult =
-                hyprload::Result<std::monostate, std::string>::ok(std::monostate());
-        });
+        // update self
+
+        std::shared_ptr<hyprload::BuildProcessDescriptor> descriptor =
+            std::make_shared<hyprload::BuildProcessDescriptor>(
+                "hyprload", std::make_shared<plugin::SelfSource>());
+
+        m_vBuildProcesses.push_back(descriptor);
+
+        bool forceUpdate = !checkIfHyprloadFullyCompatible();
 
-        thread.detach();
+        addRequirementNodes(graph, descriptor, headersNode, true, forceUpdate, BUILD_PRIORITY_SELF);
 
         config::g_pHyprloadConfig->reloadConfig();
 
+        setupSourceWatcher();
+
         const std::vector<plugin::PluginRequirement>& requirements =
             config::g_pHyprloadConfig->getPlugins();
 
@@ -258,63 +440,63 @@ namespace hyprload {
                 std::make_shared<hyprload::BuildProcessDescriptor>(std::string(plugin.getName()),
                                                                    plugin.getSource());
 
-            auto myDescriptor = descriptor;
-            m_vBuildProcesses.push_back(myDescriptor);
+            m_vBuildProcesses.push_back(descriptor);
 
-            std::thread thread = std::thread([descriptor, forceUpdate]() {
-                std::unique_lock<std::mutex> headerLock = std::unique_lock(g_mSetupHeadersMutex);
-                g_cvSetupHeaders.wait(headerLock, []() { return g_bHeadersReady.has_value(); });
-
-                if (g_bHeadersReady.value().isOk()) {
-                    headerLock.unlock();
-                } else {
-                    auto lock = std::unique_lock<std::mutex>(descriptor->m_mMutex);
+            addRequirementNodes(graph, descriptor, headersNode, true, forceUpdate,
+                                BUILD_PRIORITY_PLUGIN);
+        }
 
-                    descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                        "Failed to setup Hyprland headers");
-                    return;
-                }
+        m_pBuildScheduler->submit(graph);
+    }
 
-                auto source = descriptor->m_pSource;
+    void Hyprload::publishPlugins() {
+        if (m_bIsBuilding) {
+            error("Can't publish plugins while updating them");
+            return;
+        }
 
-                if (!source->isSourceAvailable()) {
-                    auto result = source->installSource();
+        config::g_pHyprloadConfig->reloadConfig();
 
-                    if (result.isErr()) {
-                        auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+        usize published = 0;
 
-                        descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                            "Failed to install " + descriptor->m_sName +
-                            " source: " + result.unwrapErr());
-                        return;
-                    }
-                }
+        for (const plugin::PluginRequirement& plugin : config::g_pHyprloadConfig->getPlugins()) {
+            // Nothing else could look a local build up
+            if (std::dynamic_pointer_cast<plugin::LocalPluginSource>(plugin.getSource())) {
+                debug("Not publishing local plugin " + plugin.getName());
+                continue;
+            }
 
-                if (source->isUpToDate() && !forceUpdate) {
-                    auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+            auto result = artifact::publishArtifact(plugin.getName(), *plugin.getSource());
 
-                    descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                        "Source is up to date, skipping update...");
-                    return;
-                }
+            if (result.isErr()) {
+                error("Failed to publish " + plugin.getName() + ": " + result.unwrapErr());
+                continue;
+            }
 
-                auto result = source->update(descriptor->m_sName);
+            published++;
+        }
 
-                if (result.isErr()) {
-                    auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+        success("Published " + std::to_string(published) + " plugins");
+    }
 
-                    descriptor->m_rResult = hyprload::Result<std::monostate, std::string>::err(
-                        "Failed to update " + descriptor->m_sName + ": " + result.unwrapErr());
-                    return;
-                }
-                auto lock = std::scoped_lock<std::mutex>(descriptor->m_mMutex);
+    void Hyprload::rollbackPlugins() {
+        if (m_bIsBuilding) {
+            error("Can't roll back plugins while updating them");
+            return;
+        }
 
-                descriptor->m_rResult =
-                    hyprload::Result<std::monostate, std::string>::ok(std::monostate());
-            });
+        auto result = install::rollback();
 
-            thread.detach();
+        if (result.isErr()) {
+            error("Failed to roll back: " + result.unwrapErr());
+            return;
         }
+
+        success("Rolled back to generation " + std::to_string(result.unwrap()));
+
+        lock::restorePlugins();
+
+        reloadPlugins();
     }
 
     std::string Hyprload::fetchHyprlandCommitHash() {
@@ -330,136 +512,318 @@ namespace hyprload {
     }
 
     const std::string& Hyprload::getCurrentHyprlandCommitHash() {
-        if (m_sHyprlandCommitNow.empty()) {
-            m_sHyprlandCommitNow = fetchHyprlandCommitHash();
-        }
+        // Build workers read it too, setupBuildScheduler fetches it before they run
+        std::call_once(m_fHyprlandCommitFetched,
+                       [this]() { m_sHyprlandCommitNow = fetchHyprlandCommitHash(); });
 
         return m_sHyprlandCommitNow;
     }
 
-    void Hyprload::setupHeaders() {
-        std::string commitHash = fetchHyprlandCommitHash();
-        debug("Hyprland commit hash: " + commitHash);
+    static std::vector<std::string> readHeaderStamp(const std::string& commitHash) {
+        std::filesystem::path stampPath = getHyprlandHeadersStampPath();
 
-        std::thread thread = std::thread([commitHash]() {
-            std::unique_lock<std::mutex> headerLock = std::unique_lock(g_mSetupHeadersMutex);
+        if (!std::filesystem::exists(stampPath)) {
+            return {};
+        }
 
-            std::optional<std::filesystem::path> configHyprlandHeadersPath =
-                hyprload::getConfigHyprlandHeadersPath();
+        toml::table stamp;
+        try {
+            stamp = toml::parse_file(stampPath.string());
+        } catch (const std::exception& e) {
+            debug("Failed to parse header stamp: " + std::string(e.what()));
+            return {};
+        }
 
-            if (configHyprlandHeadersPath.has_value()) {
-                g_bHeadersReady =
-                    hyprload::Result<std::monostate, std::string>::ok(std::monostate());
-                headerLock.unlock();
-                g_cvSetupHeaders.notify_all();
-                return;
-            }
+        if (stamp["commit"].value_or(std::string()) != commitHash) {
+            return {};
+        }
 
-            std::optional<std::filesystem::path> hyprlandInstallationPath =
-                hyprload::getHyprlandInstallationPath();
+        std::vector<std::string> stages;
 
-            if (!hyprlandInstallationPath.has_value()) {
-                return;
+        if (const toml::array* array = stamp["stages"].as_array()) {
+            for (const auto& stage : *array) {
+                if (stage.is_string()) {
+                    stages.push_back(stage.as_string()->get());
+                }
             }
+        }
 
-            std::filesystem::path hyprlandHeadersPath = hyprlandInstallationPath.value();
+        return stages;
+    }
 
-            if (!std::filesystem::exists(hyprlandHeadersPath)) {
-                // Clone hyprland
+    static void writeHeaderStamp(const std::string& commitHash,
+                                 const std::vector<std::string>& stages) {
+        toml::array stagesArray;
 
-                const std::string hyprlandUrl = "https://github.com/hyprwm/Hyprland.git";
+        for (const auto& stage : stages) {
+            stagesArray.push_back(stage);
+        }
 
-                std::string command = "git clone " + hyprlandUrl + " " +
-                    hyprlandHeadersPath.string() + " --recurse-submodules --depth 1";
+        toml::table stamp = toml::table{
+            {"commit", commitHash},
+            {"stages", stagesArray},
+        };
 
-                std::tuple<int, std::string> result = hyprload::executeCommand(command);
+        std::filesystem::path stampPath = getHyprlandHeadersStampPath();
+        std::filesystem::path temporaryPath = stampPath;
+        temporaryPath += ".tmp";
 
-                if (std::get<0>(result) != 0) {
-                    g_bHeadersReady = hyprload::Result<std::monostate, std::string>::err(
-                        "Failed to clone Hyprland: " + std::get<1>(result));
-                    headerLock.unlock();
-                    g_cvSetupHeaders.notify_all();
-                    return;
-                }
-            }
+        std::ofstream stampFile(temporaryPath);
+        stampFile << stamp << "\n";
+        stampFile.close();
+
+        std::filesystem::rename(temporaryPath, stampPath);
+    }
 
-            // Fix submodules
-            // When building Hyprland, the wlroots submodule has changes in meson.build
-            // The reset fixes it.
-            std::string command = "git -C " +
-                (hyprlandHeadersPath / "subprojects" / "wlroots").string() + " reset --hard";
+    static hyprload::Result<std::monostate, std::string>
+    prepareHeaderSource(const std::filesystem::path& hyprlandHeadersPath,
+                        const std::string& commitHash) {
+        if (!std::filesystem::exists(hyprlandHeadersPath / ".git")) {
+            // Start from an empty repo, the exact commit is fetched below
+
+            const std::string hyprlandUrl = "https://github.com/hyprwm/Hyprland.git";
+
+            std::string command = "git init " + hyprlandHeadersPath.string() + " && git -C " +
+                hyprlandHeadersPath.string() + " remote add origin " + hyprlandUrl;
 
             std::tuple<int, std::string> result = hyprload::executeCommand(command);
 
             if (std::get<0>(result) != 0) {
-                g_bHeadersReady = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to reset submodules: " + std::get<1>(result));
-                headerLock.unlock();
-                g_cvSetupHeaders.notify_all();
-                return;
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to clone Hyprland: " + std::get<1>(result));
             }
+        }
 
-            // Reset the repo to remove any changes
-            command = "git -C " + hyprlandHeadersPath.string() + " reset --hard";
+        // Fix submodules
+        // When building Hyprland, the wlroots submodule has changes in meson.build
+        // The reset fixes it.
+        std::filesystem::path wlrootsPath = hyprlandHeadersPath / "subprojects" / "wlroots";
 
-            result = hyprload::executeCommand(command);
+        if (std::filesystem::exists(wlrootsPath / ".git")) {
+            std::string command = "git -C " + wlrootsPath.string() + " reset --hard";
+
+            std::tuple<int, std::string> result = hyprload::executeCommand(command);
 
             if (std::get<0>(result) != 0) {
-                g_bHeadersReady = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to reset Hyprland: " + std::get<1>(result));
-                headerLock.unlock();
-                g_cvSetupHeaders.notify_all();
-                return;
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to reset submodules: " + std::get<1>(result));
             }
+        }
+
+        // Fetch only the running commit, no history
+        std::string command =
+            "git -C " + hyprlandHeadersPath.string() + " fetch --depth 1 origin " + commitHash;
+
+        std::tuple<int, std::string> result = hyprload::executeCommand(command);
+
+        if (std::get<0>(result) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to fetch commit hash: " + std::get<1>(result));
+        }
+
+        // Checkout to commit hash, dropping any changes
+        command = "git -C " + hyprlandHeadersPath.string() + " checkout --force FETCH_HEAD";
+
+        result = hyprload::executeCommand(command);
 
-            // Update submodules
-            command = "git -C " + hyprlandHeadersPath.string() + " submodule update --init";
+        if (std::get<0>(result) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to checkout to commit hash: " + std::get<1>(result));
+        }
+
+        // Update submodules
+        command = "git -C " + hyprlandHeadersPath.string() +
+            " submodule update --init --recursive --depth 1";
+
+        result = hyprload::executeCommand(command);
+
+        if (std::get<0>(result) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to update submodules: " + std::get<1>(result));
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    // Include directories written to hyprland.pc, relative to the includedir
+    static const std::vector<std::string> c_pkgConfigIncludeDirs = {
+        "",
+        "hyprland/protocols",
+        "hyprland/subprojects/wlroots/include",
+        "hyprland/subprojects/wlroots/build/include",
+    };
+
+    static hyprload::Result<std::monostate, std::string>
+    prepareHeaderBuild(const std::filesystem::path& hyprlandHeadersPath) {
+        // Make headers
+        std::string command = "make -C " + hyprlandHeadersPath.string() + " all";
+
+        std::tuple<int, std::string> result = hyprload::executeCommand(command);
+
+        if (std::get<0>(result) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err("Failed to make headers: " +
+                                                                      std::get<1>(result));
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    static hyprload::Result<std::monostate, std::string>
+    prepareHeaderProtocols(const std::filesystem::path& hyprlandHeadersPath) {
+        // Generate the protocol headers, without building the compositor
+        std::string command = "make -C " + hyprlandHeadersPath.string() + " protocols";
+
+        std::tuple<int, std::string> result = hyprload::executeCommand(command);
+
+        if (std::get<0>(result) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to generate protocols: " + std::get<1>(result));
+        }
+
+        // Some versions include a generated version header
+        std::filesystem::path generateVersion =
+            hyprlandHeadersPath / "scripts" / "generateVersion.sh";
+
+        if (std::filesystem::exists(generateVersion)) {
+            command = "cd " + hyprlandHeadersPath.string() + " && sh " + generateVersion.string();
 
             result = hyprload::executeCommand(command);
 
             if (std::get<0>(result) != 0) {
-                g_bHeadersReady = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to update submodules: " + std::get<1>(result));
-                headerLock.unlock();
-                g_cvSetupHeaders.notify_all();
-                return;
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to generate version header: " + std::get<1>(result));
             }
+        }
 
-            // Checkout to commit hash
-            command = "git -C " + hyprlandHeadersPath.string() + " fetch && git -C " +
-                hyprlandHeadersPath.string() + " checkout " + commitHash + " --recurse-submodules";
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
 
-            result = hyprload::executeCommand(command);
+    static hyprload::Result<std::monostate, std::string>
+    prepareHeaderWlroots(const std::filesystem::path& hyprlandHeadersPath) {
+        // Configuring wlroots is enough to generate its config and version headers
+        std::filesystem::path wlrootsPath = hyprlandHeadersPath / "subprojects" / "wlroots";
 
-            if (std::get<0>(result) != 0) {
-                g_bHeadersReady = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to checkout to commit hash: " + std::get<1>(result));
-                headerLock.unlock();
-                g_cvSetupHeaders.notify_all();
-                return;
+        std::string command = "meson setup ";
+
+        // A build directory left over from another commit has to be set up from scratch
+        if (std::filesystem::exists(wlrootsPath / "build" / "meson-private")) {
+            command += "--wipe ";
+        }
+
+        command += (wlrootsPath / "build").string() + " " + wlrootsPath.string() +
+            " --buildtype=release";
+
+        std::tuple<int, std::string> result = hyprload::executeCommand(command);
+
+        if (std::get<0>(result) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to configure wlroots: " + std::get<1>(result));
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    static hyprload::Result<std::monostate, std::string>
+    validateHeaders(const std::filesystem::path& hyprlandHeadersPath) {
+        std::filesystem::path includePath = getRootPath() / "include";
+
+        for (const std::string& includeDir : c_pkgConfigIncludeDirs) {
+            if (!std::filesystem::is_directory(includePath / includeDir)) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Missing Hyprland include directory: " + (includePath / includeDir).string());
             }
+        }
 
-            // Make headers
-            command = "make -C " + hyprlandHeadersPath.string() + " all";
+        bool hasProtocolHeaders = false;
 
-            result = hyprload::executeCommand(command);
+        for (const auto& entry :
+             std::filesystem::directory_iterator(hyprlandHeadersPath / "protocols")) {
+            if (entry.path().filename().string().ends_with("-protocol.h")) {
+                hasProtocolHeaders = true;
+                break;
+            }
+        }
 
-            if (std::get<0>(result) != 0) {
-                g_bHeadersReady = hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to make headers: " + std::get<1>(result));
-                headerLock.unlock();
-                g_cvSetupHeaders.notify_all();
-                return;
+        if (!hasProtocolHeaders) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "No protocol headers were generated in " +
+                (hyprlandHeadersPath / "protocols").string());
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    static hyprload::Result<std::monostate, std::string>
+    prepareHeaders(const std::string& commitHash) {
+        std::optional<std::filesystem::path> hyprlandInstallationPath =
+            hyprload::getHyprlandInstallationPath();
+
+        if (!hyprlandInstallationPath.has_value()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "No Hyprland installation path");
+        }
+
+        std::filesystem::path hyprlandHeadersPath = hyprlandInstallationPath.value();
+
+        // Stages of preparing the header tree, in order. Each one is recorded in the stamp file
+        // once it completes, so an interrupted setup resumes where it stopped and a tree
+        // already at the running commit is not touched at all.
+        std::vector<std::pair<std::string, BuildWork>> stages = {
+            {"source", [&]() { return prepareHeaderSource(hyprlandHeadersPath, commitHash); }},
+        };
+
+        if (isFullHeaderBuild()) {
+            stages.emplace_back("build", [&]() { return prepareHeaderBuild(hyprlandHeadersPath); });
+        } else {
+            stages.emplace_back("protocols",
+                                [&]() { return prepareHeaderProtocols(hyprlandHeadersPath); });
+            stages.emplace_back("wlroots",
+                                [&]() { return prepareHeaderWlroots(hyprlandHeadersPath); });
+        }
+
+        std::vector<std::string> completedStages;
+
+        if (std::filesystem::exists(hyprlandHeadersPath)) {
+            completedStages = readHeaderStamp(commitHash);
+        }
+
+        for (const auto& [stage, prepare] : stages) {
+            if (std::find(completedStages.begin(), completedStages.end(), stage) !=
+                completedStages.end()) {
+                debug("Hyprland headers stage " + stage + " already done, skipping");
+                continue;
             }
 
-            debug("Hyprland headers ready");
+            auto result = prepare();
 
-            g_bHeadersReady = hyprload::Result<std::monostate, std::string>::ok(std::monostate());
-            headerLock.unlock();
-            g_cvSetupHeaders.notify_all();
-        });
+            if (result.isErr()) {
+                return result;
+            }
 
-        thread.detach();
+            completedStages.push_back(stage);
+            writeHeaderStamp(commitHash, completedStages);
+        }
+
+        auto validation = validateHeaders(hyprlandHeadersPath);
+
+        if (validation.isErr()) {
+            // Make the next setup start over instead of trusting the stamp
+            writeHeaderStamp(commitHash, {});
+            return validation;
+        }
+
+        debug("Hyprland headers ready");
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    std::shared_ptr<BuildNode> Hyprload::setupHeaders(BuildGraph& graph) {
+        std::string commitHash = fetchHyprlandCommitHash();
+        debug("Hyprland commit hash: " + commitHash);
+
+        return graph.addNode(
+            "headers", [commitHash]() { return prepareHeaders(commitHash); },
+            BUILD_PRIORITY_HEADERS);
     }
 
     void Hyprload::setupPkgConfig() {
@@ -496,9 +860,55 @@ namespace hyprload {
         pkgConfigFile << "Name: Hyprland\n";
         pkgConfigFile << "Description: hyprload-overriden Hyprland header files\n";
         pkgConfigFile << "Version: custom\n";
-        pkgConfigFile << "Cflags: -I\"${includedir}\" -I\"${includedir}/hyprland/protocols\" "
-                         "-I\"${includedir}/hyprland/subprojects/wlroots/include\" "
-                         "-I\"${includedir}/hyprland/subprojects/wlroots/build/include\"\n";
+        pkgConfigFile << "Cflags:";
+
+        for (const std::string& includeDir : c_pkgConfigIncludeDirs) {
+            pkgConfigFile << " -I\"${includedir}" << (includeDir.empty() ? "" : "/" + includeDir)
+                          << "\"";
+        }
+
+        pkgConfigFile << "\n";
+    }
+
+    static void warmPlugin(const std::filesystem::path& path) {
+        fd_t fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            return;
+        }
+
+        // Pull the whole file into the page cache, so dlopen doesn't fault it in piece by piece
+        char buffer[65536];
+        while (read(fd, buffer, sizeof(buffer)) > 0) {}
+
+        close(fd);
+    }
+
+    void Hyprload::onLazyDispatch(void* data) {
+        auto& dispatches = g_pHyprload->m_vLazyDispatches;
+        auto it = std::find_if(dispatches.begin(), dispatches.end(),
+                               [data](const auto& dispatch) { return dispatch.get() == data; });
+
+        if (it == dispatches.end()) {
+            return;
+        }
+
+        // Idle sources remove themselves once dispatched
+        std::unique_ptr<SLazyDispatch> dispatch = std::move(*it);
+        dispatches.erase(it);
+
+        g_pHyprload->loadLazyPlugin(dispatch->m_sDispatcher, dispatch->m_sArgument);
+    }
+
+    void Hyprload::removeLazyDispatches(const std::optional<std::string>& plugin) {
+        std::erase_if(m_vLazyDispatches, [&plugin](const auto& dispatch) {
+            if (plugin.has_value() && dispatch->m_sPlugin != plugin.value()) {
+                return false;
+            }
+
+            wl_event_source_remove(dispatch->m_pSource);
+            return true;
+        });
     }
 
     void Hyprload::loadPlugins() {
@@ -538,65 +948,293 @@ namespace hyprload {
             return;
         }
 
-        debug("Copying plugins...");
+        debug("Staging plugins...");
 
-        std::vector<std::string> pluginFiles = std::vector<std::string>();
+        // With the config and binaries as they were last time, what was found then still holds
+        std::optional<snapshot::SStartupSnapshot> startup = snapshot::readSnapshot();
 
-        for (const auto& entry : std::filesystem::directory_iterator(sourcePluginPath)) {
-            std::string filename = entry.path().filename();
-            if (filename.find(".so") != std::string::npos) {
-                debug("Discovered plugin: " + filename);
+        if (!startup.has_value()) {
+            startup = snapshot::SStartupSnapshot();
 
-                pluginFiles.push_back(filename);
+            for (const auto& entry : std::filesystem::directory_iterator(sourcePluginPath)) {
+                std::string filename = entry.path().filename();
+                if (filename.find(".so") != std::string::npos) {
+                    debug("Discovered plugin: " + filename);
 
-                debug("Copying plugin: " + entry.path().string() + " to " +
-                      (sessionPluginPath / filename).string());
-                std::filesystem::copy(entry.path(), sessionPluginPath / filename);
+                    startup->m_vPlugins.push_back(filename);
+                }
+            }
+
+            startup->m_mLazyDispatchers = getLazyDispatchers(startup->m_vPlugins);
+
+            snapshot::writeSnapshot(startup.value());
+        } else {
+            debug("Nothing changed since the last start, skipping plugin discovery");
+        }
+
+        std::vector<std::string> pluginFiles = std::vector<std::string>();
+
+        for (const auto& plugin : startup->m_vPlugins) {
+            if (stagePlugin(plugin)) {
+                pluginFiles.push_back(plugin);
             }
         }
 
+        loadStagedPlugins(deferLazyPlugins(pluginFiles, startup->m_mLazyDispatchers));
+    }
+
+    std::optional<Hyprload::SBinaryIdentity>
+    Hyprload::getBinaryIdentity(const std::filesystem::path& path) {
+        struct stat binaryStat;
+
+        if (stat(path.c_str(), &binaryStat) != 0) {
+            return std::nullopt;
+        }
+
+        return SBinaryIdentity{
+            .m_iDevice = binaryStat.st_dev,
+            .m_iInode = binaryStat.st_ino,
+            .m_iSize = binaryStat.st_size,
+            .m_iModified = binaryStat.st_mtim.tv_sec * 1000000000 + binaryStat.st_mtim.tv_nsec,
+        };
+    }
+
+    std::filesystem::path Hyprload::getStagedPluginPath(const std::string& plugin) {
+        const SBinaryIdentity& identity = m_mPluginBinaries.at(plugin);
+
+        // dlopen hands back an object still loaded from the same path, so every binary gets its
+        // own, or a reload could keep running the old code
+        return getSessionBinariesPath().value() /
+            (std::filesystem::path(plugin).stem().string() + "." +
+             std::to_string(identity.m_iInode) + "-" + std::to_string(identity.m_iModified) +
+             ".so");
+    }
+
+    bool Hyprload::stagePlugin(const std::string& plugin) {
+        std::filesystem::path binaryPath = getPluginBinariesPath() / plugin;
+
+        std::optional<SBinaryIdentity> identity = getBinaryIdentity(binaryPath);
+
+        if (!identity.has_value()) {
+            error("Plugin binary disappeared: " + binaryPath.string());
+            return false;
+        }
+
+        m_mPluginBinaries[plugin] = identity.value();
+
+        std::filesystem::path stagedPath = getStagedPluginPath(plugin);
+
+        debug("Staging plugin: " + binaryPath.string() + " to " + stagedPath.string());
+
+        // Deployed binaries are replaced, never written to, so the session can share them
+        auto result = stageFile(binaryPath, stagedPath, true);
+
+        if (result.isErr()) {
+            error(result.unwrapErr());
+            m_mPluginBinaries.erase(plugin);
+            return false;
+        }
+
+        return true;
+    }
+
+    void Hyprload::loadStagedPlugins(const std::vector<std::string>& pluginFiles) {
+        if (pluginFiles.empty()) {
+            return;
+        }
+
+        // Reading the binaries in is the slow part of a cold load and can happen off the main
+        // thread, while earlier plugins are initialized
+        std::vector<std::future<void>> warmups = std::vector<std::future<void>>();
+
         for (auto& plugin : pluginFiles) {
-            info("Loading plugin: " + plugin);
+            warmups.push_back(
+                std::async(std::launch::async, warmPlugin, getStagedPluginPath(plugin)));
+        }
+
+        auto loadStart = std::chrono::steady_clock::now();
+
+        for (usize i = 0; i < pluginFiles.size(); i++) {
+            const std::string& plugin = pluginFiles[i];
+            std::string pluginPath = getStagedPluginPath(plugin);
+
+            warmups[i].wait();
 
-            std::string pluginPath = sessionPluginPath / plugin;
+            auto pluginStart = std::chrono::steady_clock::now();
 
-            HyprlandAPI::invokeHyprctlCommand("plugin", "load " + pluginPath);
+            std::string response =
+                HyprlandAPI::invokeHyprctlCommand("plugin", "load " + pluginPath);
+
+            auto pluginTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - pluginStart);
+
+            debug("Loaded plugin " + plugin + " in " + std::to_string(pluginTime.count()) +
+                  "ms: " + response);
 
             m_vPlugins.push_back(plugin);
         }
+
+        auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - loadStart);
+
+        info("Loaded " + std::to_string(pluginFiles.size()) + " plugins in " +
+             std::to_string(loadTime.count()) + "ms");
     }
 
-    void Hyprload::clearPlugins() {
-        if (!m_sSessionGuid.has_value()) {
-            debug("Session guid does not exist, will not clear plugins...");
+    std::unordered_map<std::string, std::vector<std::string>>
+    Hyprload::getLazyDispatchers(const std::vector<std::string>& pluginFiles) {
+        const std::vector<plugin::PluginRequirement>& requirements =
+            config::g_pHyprloadConfig->getPlugins();
+
+        std::unordered_map<std::string, std::vector<std::string>> lazyDispatchers;
+
+        for (const auto& plugin : pluginFiles) {
+            std::string name = plugin.substr(0, plugin.find(".so"));
+
+            auto requirement = std::find_if(requirements.begin(), requirements.end(),
+                                            [&name](const plugin::PluginRequirement& requirement) {
+                                                return requirement.getName() == name &&
+                                                    requirement.isLazy();
+                                            });
+
+            if (requirement == requirements.end()) {
+                continue;
+            }
+
+            auto pluginManifest =
+                plugin::getPluginManifest(requirement->getSource()->getSourcePath(), name);
+
+            if (pluginManifest.isErr() || pluginManifest.unwrap()->getDispatchers().empty()) {
+                debug("Plugin " + name + " declares no dispatchers, loading it now");
+                continue;
+            }
+
+            lazyDispatchers[plugin] = pluginManifest.unwrap()->getDispatchers();
+        }
+
+        return lazyDispatchers;
+    }
+
+    std::vector<std::string> Hyprload::deferLazyPlugins(
+        const std::vector<std::string>& pluginFiles,
+        const std::unordered_map<std::string, std::vector<std::string>>& lazyDispatchers) {
+        std::vector<std::string> eagerPlugins = std::vector<std::string>();
+
+        for (const auto& plugin : pluginFiles) {
+            auto lazy = lazyDispatchers.find(plugin);
+
+            if (lazy == lazyDispatchers.end()) {
+                eagerPlugins.push_back(plugin);
+                continue;
+            }
+
+            const std::vector<std::string>& dispatchers = lazy->second;
+
+            for (const auto& dispatcher : dispatchers) {
+                HyprlandAPI::addDispatcher(
+                    PHANDLE, dispatcher, [this, plugin, dispatcher](std::string argument) {
+                        // The plugin replaces this stub with its own dispatcher, which can't
+                        // happen while the stub runs
+                        auto dispatch = std::make_unique<SLazyDispatch>(SLazyDispatch{
+                            .m_sPlugin = plugin,
+                            .m_sDispatcher = dispatcher,
+                            .m_sArgument = argument,
+                        });
+
+                        dispatch->m_pSource = wl_event_loop_add_idle(
+                            g_pCompositor->m_sWLEventLoop, onLazyDispatch, dispatch.get());
+
+                        m_vLazyDispatches.push_back(std::move(dispatch));
+                    });
+            }
+
+            debug("Deferring plugin " + plugin + " until one of its dispatchers is used");
+
+            m_mLazyPlugins[plugin] = dispatchers;
+        }
+
+        return eagerPlugins;
+    }
+
+    void Hyprload::loadLazyPlugin(const std::string& dispatcher, const std::string& argument) {
+        auto lazy = std::find_if(m_mLazyPlugins.begin(), m_mLazyPlugins.end(),
+                                 [&dispatcher](const auto& lazy) {
+                                     return std::find(lazy.second.begin(), lazy.second.end(),
+                                                      dispatcher) != lazy.second.end();
+                                 });
+
+        // Otherwise an earlier use already loaded it
+        if (lazy != m_mLazyPlugins.end()) {
+            std::string plugin = lazy->first;
+
+            for (const auto& stub : lazy->second) {
+                HyprlandAPI::removeDispatcher(PHANDLE, stub);
+            }
+
+            m_mLazyPlugins.erase(lazy);
+
+            loadStagedPlugins({plugin});
+        }
+
+        auto handler = g_pKeybindManager->m_mDispatchers.find(dispatcher);
+
+        if (handler == g_pKeybindManager->m_mDispatchers.end()) {
+            error("No plugin provided the dispatcher " + dispatcher);
             return;
         }
 
-        std::filesystem::path sessionPluginPath = getSessionBinariesPath().value();
+        handler->second(argument);
+    }
+
+    void Hyprload::unloadPlugin(const std::string& plugin) {
+        removeLazyDispatches(plugin);
+
+        if (auto lazy = m_mLazyPlugins.find(plugin); lazy != m_mLazyPlugins.end()) {
+            for (const auto& stub : lazy->second) {
+                HyprlandAPI::removeDispatcher(PHANDLE, stub);
+            }
+
+            m_mLazyPlugins.erase(lazy);
+            std::filesystem::remove(getStagedPluginPath(plugin));
+            m_mPluginBinaries.erase(plugin);
+
+            return;
+        }
+
+        std::string pluginPath = getStagedPluginPath(plugin);
         std::vector<CPlugin*> plugins = g_pPluginSystem->getAllPlugins();
 
-        debug("Plugin count: " + std::to_string(plugins.size()));
+        info("Unloading plugin: " + plugin);
 
-        std::vector<std::string> pluginFiles = std::vector<std::string>();
+        if (std::none_of(plugins.begin(), plugins.end(), [&pluginPath](CPlugin* plugin) {
+                return plugin->path == pluginPath;
+            })) {
+            debug("Plugin not found in plugin system, likely already unloaded, skipping "
+                  "unload...");
+        } else {
+            HyprlandAPI::invokeHyprctlCommand("plugin", "unload " + pluginPath);
+        }
 
-        for (auto& plugin : m_vPlugins) {
-            info("Unloading plugin: " + plugin);
+        m_vPlugins.erase(std::remove(m_vPlugins.begin(), m_vPlugins.end(), plugin),
+                         m_vPlugins.end());
+        std::filesystem::remove(pluginPath);
+        m_mPluginBinaries.erase(plugin);
+    }
 
-            std::string pluginPath = sessionPluginPath / plugin;
+    void Hyprload::clearPlugins() {
+        if (!m_sSessionGuid.has_value()) {
+            debug("Session guid does not exist, will not clear plugins...");
+            return;
+        }
 
-            if (std::none_of(plugins.begin(), plugins.end(), [&pluginPath](CPlugin* plugin) {
-                    return plugin->path == pluginPath;
-                })) {
-                debug("Plugin not found in plugin system, likely already unloaded, skipping "
-                      "unload...");
-                continue;
-            }
+        std::vector<std::string> pluginFiles = m_vPlugins;
 
+        for (const auto& [plugin, dispatchers] : m_mLazyPlugins) {
             pluginFiles.push_back(plugin);
         }
 
         for (auto& plugin : pluginFiles) {
-            HyprlandAPI::invokeHyprctlCommand("plugin", "unload " + plugin);
+            unloadPlugin(plugin);
         }
 
         cleanupPlugin();
@@ -604,20 +1242,30 @@ namespace hyprload {
 
     void Hyprload::cleanupPlugin() {
         std::filesystem::path sessionPluginPath = getSessionBinariesPath().value();
-        std::filesystem::path pluginBinariesPath = getPluginBinariesPath();
+
+        removeLazyDispatches(std::nullopt);
 
         m_vPlugins.clear();
+        m_mPluginBinaries.clear();
 
         debug("Removing lock file...");
 
         unlockSession();
 
-        std::filesystem::remove_all(sessionPluginPath);
+        // Unlocked now, so if hyprload is being unloaded the next start removes what's left
+        g_pJanitor->removeTree(sessionPluginPath);
 
+        // Plugins no longer required are removed by the next reload or update, not while
+        // Hyprland waits on the unload
+        m_sSessionGuid = std::nullopt;
+    }
+
+    void Hyprload::removeUnwantedBinaries() {
         const std::vector<plugin::PluginRequirement>& requirements =
             config::g_pHyprloadConfig->getPlugins();
+        std::vector<std::string> unwanted;
 
-        for (auto& entry : std::filesystem::directory_iterator(pluginBinariesPath)) {
+        for (auto& entry : std::filesystem::directory_iterator(getPluginBinariesPath())) {
             std::string filename = entry.path().filename();
             if (filename.find(".so") != std::string::npos) {
                 std::string pluginName = filename.substr(0, filename.find(".so"));
@@ -628,19 +1276,78 @@ namespace hyprload {
                                  })) {
                     debug("Plugin " + pluginName + " not in requirements, removing...");
 
-                    std::filesystem::remove(entry.path());
+                    unwanted.push_back(pluginName);
                 }
             }
         }
 
-        m_sSessionGuid = std::nullopt;
+        if (unwanted.empty()) {
+            return;
+        }
+
+        // The generation before still has them, in case they are wanted back
+        auto result = install::commitBinaries({}, unwanted);
+
+        if (result.isErr()) {
+            error("Failed to remove plugins: " + result.unwrapErr());
+            return;
+        }
+
+        lock::commitPlugins({}, requirements);
     }
 
     void Hyprload::reloadPlugins() {
+        if (!m_sSessionGuid.has_value()) {
+            loadPlugins();
+            return;
+        }
+
         info("Reloading plugins...");
 
-        clearPlugins();
-        loadPlugins();
+        removeUnwantedBinaries();
+
+        std::vector<std::string> binaries = std::vector<std::string>();
+
+        for (const auto& entry : std::filesystem::directory_iterator(getPluginBinariesPath())) {
+            std::string filename = entry.path().filename();
+            if (filename.find(".so") != std::string::npos) {
+                binaries.push_back(filename);
+            }
+        }
+
+        std::vector<std::string> loadedPlugins = m_vPlugins;
+
+        for (const auto& [plugin, dispatchers] : m_mLazyPlugins) {
+            loadedPlugins.push_back(plugin);
+        }
+
+        for (auto& plugin : loadedPlugins) {
+            if (std::find(binaries.begin(), binaries.end(), plugin) == binaries.end()) {
+                unloadPlugin(plugin);
+            }
+        }
+
+        // Deploys replace binaries, so an unchanged identity means an unchanged plugin
+        std::vector<std::string> pluginFiles = std::vector<std::string>();
+
+        for (auto& plugin : binaries) {
+            auto loaded = m_mPluginBinaries.find(plugin);
+
+            if (loaded != m_mPluginBinaries.end()) {
+                if (getBinaryIdentity(getPluginBinariesPath() / plugin) == loaded->second) {
+                    debug("Plugin " + plugin + " unchanged, keeping it loaded");
+                    continue;
+                }
+
+                unloadPlugin(plugin);
+            }
+
+            if (stagePlugin(plugin)) {
+                pluginFiles.push_back(plugin);
+            }
+        }
+
+        loadStagedPlugins(deferLazyPlugins(pluginFiles, getLazyDispatchers(pluginFiles)));
 
         success("Reloaded plugins!");
     }
@@ -700,38 +1407,10 @@ namespace hyprload {
         }
     }
 
-    void tryCleanupPreviousSessions() {
-        std::filesystem::path pluginsPath = getPluginsPath();
-
-        for (const auto& entry : std::filesystem::directory_iterator(pluginsPath)) {
-            std::string sessionPath = entry.path().filename();
-            if (sessionPath.find("session.") != std::string::npos) {
-                debug("Found previous session: " + sessionPath);
-
-                std::filesystem::path lockFile = entry.path() / "lock";
-                if (std::filesystem::exists(lockFile)) {
-                    std::optional<int> lock = tryGetLock(lockFile);
+    void Hyprload::cleanupPreviousSessions() {
+        debug("Removing stale sessions and generations in the background");
 
-                    if (!lock.has_value()) {
-                        debug("Lock file exists, and is locked, skipping session: " + sessionPath);
-                    } else if (lock.value() == -1) {
-                        debug("Failed to get lock file, something is wrong...");
-
-                        releaseLock(lock.value());
-                        std::filesystem::remove_all(entry.path());
-                    } else {
-                        debug("Lock file exists, but is not locked (possible crash without "
-                              "unloading), removing session: " +
-                              sessionPath);
-
-                        releaseLock(lock.value());
-                        std::filesystem::remove_all(entry.path());
-                    }
-                } else {
-                    debug("Lock file does not exist, removing session: " + sessionPath);
-                    std::filesystem::remove_all(entry.path());
-                }
-            }
-        }
+        g_pJanitor->removeStaleSessions(getSessionBinariesPath());
+        install::collectRemovedGenerations();
     }
 }
@@ -16,44 +16,24 @@ namespace hyprload::config {
         return std::filesystem::path(hyprloadConfig->strValue);
     }
 
-    HyprloadConfig::HyprloadConfig() {
-        try {
-            m_pConfig = std::make_unique<toml::table>(toml::parse_file(getConfigPath().u8string()));
-        } catch (const std::exception& e) {
-            const std::string error = e.what();
-            hyprload::error("Failed to parse config file: " + error);
-            return;
-        }
-
-        if (m_pConfig->contains("plugins") && m_pConfig->get("plugins")->is_array()) {
-            m_pConfig->get("plugins")->as_array()->for_each(
-                [&plugins = m_vPluginsWanted](const toml::node& value) {
-                    if (value.is_string()) {
-                        plugins.emplace_back(value.as_string()->get());
-                    } else if (value.is_table()) {
-                        try {
-                            plugins.emplace_back(*value.as_table());
-                        } catch (const std::exception& e) {
-                            const std::string error = e.what();
-                            hyprload::error("Failed to parse plugin: " + error);
-                        }
-                    } else {
-                        hyprload::error("Plugin must be a string or table");
-                    }
-                });
-        }
-
-    }
+    HyprloadConfig::HyprloadConfig() {}
 
     void HyprloadConfig::reloadConfig() {
         m_pConfig = nullptr;
         m_vPluginsWanted.clear();
 
+        parseConfig();
+    }
+
+    void HyprloadConfig::parseConfig() {
+        m_bParsed = true;
+
         try {
             m_pConfig = std::make_unique<toml::table>(toml::parse_file(getConfigPath().u8string()));
         } catch (const std::exception& e) {
             const std::string error = e.what();
             hyprload::error("Failed to parse config file: " + error);
+            m_pConfig = std::make_unique<toml::table>();
             return;
         }
 
@@ -76,11 +56,19 @@ namespace hyprload::config {
         }
     }
 
-    const toml::table& HyprloadConfig::getConfig() const {
+    const toml::table& HyprloadConfig::getConfig() {
+        if (!m_bParsed) {
+            parseConfig();
+        }
+
         return *m_pConfig;
     }
 
-    const std::vector<hyprload::plugin::PluginRequirement>& HyprloadConfig::getPlugins() const {
+    const std::vector<hyprload::plugin::PluginRequirement>& HyprloadConfig::getPlugins() {
+        if (!m_bParsed) {
+            parseConfig();
+        }
+
         return m_vPluginsWanted;
     }
 }
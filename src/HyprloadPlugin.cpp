@@ -3,72 +3,140 @@
 
 #include "HyprloadPlugin.hpp"
 #include "Hyprload.hpp"
+#include "HyprloadConfig.hpp"
+#include "ArtifactStore.hpp"
+#include "BuildCache.hpp"
+#include "Hash.hpp"
+#include "InstallTransaction.hpp"
+#include "Jobserver.hpp"
+#include "Lockfile.hpp"
+#include "SourceIndex.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <sstream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include <sys/stat.h>
+
 #include <hyprland/src/helpers/MiscFunctions.hpp>
 #include "toml/toml.hpp"
 
 namespace hyprload::plugin {
-    hyprload::Result<HyprloadManifest, std::string>
+    const std::string c_selfSourceUrl = "https://github.com/Duckonaut/hyprload.git";
+
+    // Parsed manifests, kept until the file changes. Handed out shared, and never modified.
+    hyprload::Result<std::shared_ptr<const HyprloadManifest>, std::string>
     getHyprloadManifest(const std::filesystem::path& sourcePath) {
+        struct SCachedManifest {
+            dev_t m_iDevice;
+            ino_t m_iInode;
+            off_t m_iSize;
+            i64 m_iModified;
+            std::shared_ptr<const HyprloadManifest> m_pManifest;
+        };
+
+        static std::mutex manifestsMutex;
+        static std::unordered_map<std::string, SCachedManifest> manifests;
+
         std::filesystem::path manifestPath = sourcePath / "hyprload.toml";
 
-        if (!std::filesystem::exists(manifestPath)) {
-            return hyprload::Result<HyprloadManifest, std::string>::err(
+        struct stat manifestStat;
+
+        if (stat(manifestPath.c_str(), &manifestStat) != 0) {
+            return hyprload::Result<std::shared_ptr<const HyprloadManifest>, std::string>::err(
                 "Source does not have a hyprload.toml manifest");
         }
 
-        toml::table manifest;
+        i64 modified = manifestStat.st_mtim.tv_sec * 1000000000 + manifestStat.st_mtim.tv_nsec;
+
+        {
+            auto lock = std::scoped_lock<std::mutex>(manifestsMutex);
+            auto it = manifests.find(manifestPath.string());
+
+            if (it != manifests.end() && it->second.m_iDevice == manifestStat.st_dev &&
+                it->second.m_iInode == manifestStat.st_ino &&
+                it->second.m_iSize == manifestStat.st_size && it->second.m_iModified == modified) {
+                return hyprload::Result<std::shared_ptr<const HyprloadManifest>, std::string>::ok(
+                    std::shared_ptr<const HyprloadManifest>(it->second.m_pManifest));
+            }
+        }
+
+        std::shared_ptr<const HyprloadManifest> manifest;
         try {
-            manifest = toml::parse_file(manifestPath.string());
+            manifest = std::make_shared<const HyprloadManifest>(
+                toml::parse_file(manifestPath.string()));
         } catch (const std::exception& e) {
-            return hyprload::Result<HyprloadManifest, std::string>::err(
+            return hyprload::Result<std::shared_ptr<const HyprloadManifest>, std::string>::err(
                 "Failed to parse source manifest: " + std::string(e.what()));
         }
 
-        return hyprload::Result<HyprloadManifest, std::string>::ok(HyprloadManifest(manifest));
+        {
+            auto lock = std::scoped_lock<std::mutex>(manifestsMutex);
+
+            manifests[manifestPath.string()] = SCachedManifest{
+                .m_iDevice = manifestStat.st_dev,
+                .m_iInode = manifestStat.st_ino,
+                .m_iSize = manifestStat.st_size,
+                .m_iModified = modified,
+                .m_pManifest = manifest,
+            };
+        }
+
+        return hyprload::Result<std::shared_ptr<const HyprloadManifest>, std::string>::ok(
+            std::move(manifest));
     }
 
-    hyprload::Result<PluginManifest, std::string>
+    hyprload::Result<std::shared_ptr<const PluginManifest>, std::string>
     getPluginManifest(const std::filesystem::path& sourcePath, const std::string& name) {
-
         auto hyprloadManifestResult = getHyprloadManifest(sourcePath);
 
         if (hyprloadManifestResult.isErr()) {
-            return hyprload::Result<PluginManifest, std::string>::err(
+            return hyprload::Result<std::shared_ptr<const PluginManifest>, std::string>::err(
                 hyprloadManifestResult.unwrapErr());
         }
 
-        const auto& hyprloadManifest = hyprloadManifestResult.unwrap();
+        std::shared_ptr<const HyprloadManifest> hyprloadManifest = hyprloadManifestResult.unwrap();
 
-        std::optional<PluginManifest> pluginManifest;
+        const PluginManifest* pluginManifest = hyprloadManifest->findPlugin(name);
 
-        for (const auto& plugin : hyprloadManifest.getPlugins()) {
-            if (plugin.getName() == name) {
-                pluginManifest = plugin;
-                break;
-            }
+        if (!pluginManifest) {
+            return hyprload::Result<std::shared_ptr<const PluginManifest>, std::string>::err(
+                "Plugin does not have a manifest for " + name);
         }
 
-        if (!pluginManifest.has_value()) {
-            return hyprload::Result<PluginManifest, std::string>::err(
-                "Plugin does not have a manifest for " + name);
+        // Shares ownership of the whole manifest it is part of
+        return hyprload::Result<std::shared_ptr<const PluginManifest>, std::string>::ok(
+            std::shared_ptr<const PluginManifest>(hyprloadManifest, pluginManifest));
+    }
+
+    std::optional<std::string> getPluginCacheKey(const PluginManifest& pluginManifest,
+                                                 const std::optional<std::string>& revision) {
+        if (!revision.has_value()) {
+            return std::nullopt;
         }
 
-        return hyprload::Result<PluginManifest, std::string>::ok(std::move(pluginManifest.value()));
+        return cache::getCacheKey(cache::SBuildInputs{
+            .m_sName = pluginManifest.getName(),
+            .m_sRevision = revision.value(),
+            .m_vBuildSteps = pluginManifest.getBuildSteps(),
+            .m_pBinaryOutputPath = pluginManifest.getBinaryOutputPath(),
+            .m_sHyprlandCommit = g_pHyprload->getCurrentHyprlandCommitHash(),
+        });
     }
 
     hyprload::Result<std::monostate, std::string>
-    buildPlugin(const std::filesystem::path& sourcePath, const std::string& name) {
+    buildPlugin(const std::filesystem::path& sourcePath, const std::string& name,
+                const std::optional<std::string>& revision) {
         auto pluginManifestResult = getPluginManifest(sourcePath, name);
 
         if (pluginManifestResult.isErr()) {
@@ -76,27 +144,178 @@ namespace hyprload::plugin {
                 pluginManifestResult.unwrapErr());
         }
 
-        const auto& pluginManifest = pluginManifestResult.unwrap();
+        std::shared_ptr<const PluginManifest> pluginManifest = pluginManifestResult.unwrap();
+
+        std::optional<std::string> cacheKey = getPluginCacheKey(*pluginManifest, revision);
+
+        if (cacheKey.has_value() && cache::findArtifact(cacheKey.value()).has_value()) {
+            debug("Build cache hit for " + name + ", skipping build");
+            return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        }
+
+        if (cacheKey.has_value() && getArtifactStoreUrl().has_value()) {
+            auto result = artifact::fetchArtifact(name, revision.value(), cacheKey.value());
+
+            if (result.isOk()) {
+                debug("Fetched prebuilt " + name + ", skipping build");
+                return result;
+            }
+
+            // A miss only means this machine builds it itself
+            debug(result.unwrapErr());
+        }
 
-        std::string buildSteps = "export PKG_CONFIG_PATH=" + getPkgConfigOverridePath().string() +
-            " && cd " + sourcePath.string() + " && ";
+        std::string buildSteps = getJobserverExports() + "export PKG_CONFIG_PATH=" +
+            getPkgConfigOverridePath().string() + " && cd " + sourcePath.string() + " && ";
 
-        for (const std::string& step : pluginManifest.getBuildSteps()) {
+        for (const std::string& step : pluginManifest->getBuildSteps()) {
             buildSteps += step + " && ";
         }
 
         buildSteps += "cd -";
 
-        auto [exit, output] = executeCommand(buildSteps);
+        auto [exit, output] = executeCommand(buildSteps, std::nullopt, true);
 
         if (exit != 0) {
             return hyprload::Result<std::monostate, std::string>::err("Failed to build plugin: " +
                                                                       output);
         }
 
+        if (cacheKey.has_value()) {
+            auto result = cache::storeArtifact(cacheKey.value(),
+                                               sourcePath / pluginManifest->getBinaryOutputPath());
+
+            if (result.isErr()) {
+                debug(result.unwrapErr());
+            }
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    hyprload::Result<std::monostate, std::string>
+    deployPlugin(const std::filesystem::path& sourcePath, const std::string& name,
+                 const std::optional<std::string>& revision) {
+        auto pluginManifestResult = getPluginManifest(sourcePath, name);
+
+        if (pluginManifestResult.isErr()) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                pluginManifestResult.unwrapErr());
+        }
+
+        std::shared_ptr<const PluginManifest> pluginManifest = pluginManifestResult.unwrap();
+
+        // Only staged, the install transaction swaps it in once every plugin is deployed
+        std::filesystem::path targetPath = install::getStagedBinaryPath(name);
+
+        std::error_code ec;
+        std::filesystem::create_directories(targetPath.parent_path(), ec);
+
+        std::optional<std::string> cacheKey = getPluginCacheKey(*pluginManifest, revision);
+
+        if (cacheKey.has_value() && cache::restoreArtifact(cacheKey.value(), targetPath).isOk()) {
+            return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        }
+
+        std::filesystem::path outputBinary = sourcePath / pluginManifest->getBinaryOutputPath();
+
+        if (!std::filesystem::exists(outputBinary)) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Plugin binary does not exist");
+        }
+
+        auto result = stageFile(outputBinary, targetPath, false);
+
+        if (result.isErr()) {
+            return result;
+        }
+
+        // Sessions hard link deployed binaries, so they must only ever be replaced
+        std::filesystem::permissions(targetPath,
+                                     std::filesystem::perms::owner_read |
+                                         std::filesystem::perms::group_read |
+                                         std::filesystem::perms::others_read,
+                                     ec);
+
         return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
     }
 
+    std::optional<std::string> getLocalRevision(const std::filesystem::path& sourcePath,
+                                                const std::string& ref) {
+        std::string command =
+            "git -C " + sourcePath.string() + " rev-parse --verify -q " + ref + "^{commit}";
+
+        auto [exit, output] = executeCommand(command);
+
+        if (exit != 0) {
+            return std::nullopt;
+        }
+
+        return output.substr(0, output.find_last_not_of(" \n") + 1);
+    }
+
+    // The commit a ref points to on the remote, without fetching anything. Every variant of a
+    // url is answered by one ls-remote, which is reused for the configured time.
+    std::optional<std::string> getRemoteRevision(const std::string& url, const std::string& ref) {
+        struct SRemoteRefs {
+            std::mutex m_mMutex;
+            std::chrono::steady_clock::time_point m_tFetched;
+            std::optional<std::unordered_map<std::string, std::string>> m_mRefs;
+        };
+
+        static std::mutex remotesMutex;
+        static std::unordered_map<std::string, std::shared_ptr<SRemoteRefs>> remotes;
+
+        std::shared_ptr<SRemoteRefs> remote;
+        {
+            auto lock = std::scoped_lock<std::mutex>(remotesMutex);
+            auto& entry = remotes[url];
+
+            if (!entry) {
+                entry = std::make_shared<SRemoteRefs>();
+            }
+
+            remote = entry;
+        }
+
+        // Concurrent checks of one url wait for the first one's answer
+        auto lock = std::scoped_lock<std::mutex>(remote->m_mMutex);
+
+        if (!remote->m_mRefs.has_value() ||
+            std::chrono::steady_clock::now() - remote->m_tFetched > getRemoteCheckTtl()) {
+            std::string command = "git ls-remote " + url + " HEAD 'refs/heads/*'";
+
+            auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+            if (exit != 0) {
+                return std::nullopt;
+            }
+
+            std::unordered_map<std::string, std::string> refs;
+            std::istringstream lines(output);
+            std::string line;
+
+            while (std::getline(lines, line)) {
+                usize tab = line.find('\t');
+
+                if (tab != std::string::npos) {
+                    refs[line.substr(tab + 1)] = line.substr(0, tab);
+                }
+            }
+
+            remote->m_mRefs = std::move(refs);
+            remote->m_tFetched = std::chrono::steady_clock::now();
+        }
+
+        auto it = remote->m_mRefs->find(ref);
+
+        if (it == remote->m_mRefs->end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
     PluginManifest::PluginManifest(std::string&& name, const toml::table& manifest) {
         m_sName = name;
 
@@ -150,6 +369,16 @@ namespace hyprload::plugin {
         } else {
             throw std::runtime_error("Plugin must have a build table");
         }
+
+        if (manifest.contains("dispatchers") && manifest["dispatchers"].is_array()) {
+            manifest["dispatchers"].as_array()->for_each(
+                [&dispatchers = m_vDispatchers](const toml::node& value) {
+                    if (!value.is_string()) {
+                        throw std::runtime_error("Dispatcher must be a string");
+                    }
+                    dispatchers.push_back(value.as_string()->get());
+                });
+        }
     }
 
     const std::string& PluginManifest::getName() const {
@@ -176,21 +405,38 @@ namespace hyprload::plugin {
         return m_sBuildSteps;
     }
 
+    const std::vector<std::string>& PluginManifest::getDispatchers() const {
+        return m_vDispatchers;
+    }
+
     HyprloadManifest::HyprloadManifest(const toml::table& manifest) {
         m_vPlugins = std::vector<PluginManifest>();
         manifest.for_each([&plugins = m_vPlugins](const toml::key& key, const toml::node& value) {
             if (value.is_table()) {
                 debug("Found plugin " + std::string(key.str()) + " in hyprload manifest");
-                toml::table table = *value.as_table();
-                plugins.emplace_back(std::string(key.str()), table);
+                plugins.emplace_back(std::string(key.str()), *value.as_table());
             }
         });
+
+        for (usize i = 0; i < m_vPlugins.size(); i++) {
+            m_mPluginsByName[m_vPlugins[i].getName()] = i;
+        }
     }
 
     const std::vector<PluginManifest>& HyprloadManifest::getPlugins() const {
         return m_vPlugins;
     }
 
+    const PluginManifest* HyprloadManifest::findPlugin(const std::string& name) const {
+        auto it = m_mPluginsByName.find(name);
+
+        if (it == m_mPluginsByName.end()) {
+            return nullptr;
+        }
+
+        return &m_vPlugins[it->second];
+    }
+
     bool PluginSource::operator==(const PluginSource& other) const {
         if (typeid(*this) != typeid(other)) {
             return false;
@@ -200,9 +446,13 @@ namespace hyprload::plugin {
     }
 
     GitPluginSource::GitPluginSource(std::string&& url, std::optional<std::string>&& branch,
-                                     std::optional<std::string>&& rev) {
+                                     std::optional<std::string>&& rev,
+                                     eFetchStrategy fetchStrategy,
+                                     std::vector<std::string>&& sparsePaths) {
         m_sBranch = branch;
         m_sRev = rev;
+        m_eFetchStrategy = fetchStrategy;
+        m_vSparsePaths = std::move(sparsePaths);
 
         if (url.find("https://") == 0) {
             m_sUrl = url;
@@ -226,58 +476,317 @@ namespace hyprload::plugin {
         }
     }
 
+    std::string GitPluginSource::getIdentifier() const {
+        return m_pSourcePath.filename().string();
+    }
+
+    std::optional<std::string> GitPluginSource::getRevision() const {
+        std::string command = "git -C " + m_pSourcePath.string() + " rev-parse HEAD";
+
+        auto [exit, output] = executeCommand(command);
+
+        if (exit != 0) {
+            return std::nullopt;
+        }
+
+        return output.substr(0, output.find_last_not_of(" \n") + 1);
+    }
+
+    std::filesystem::path GitPluginSource::getSourcePath() const {
+        return m_pSourcePath;
+    }
+
     hyprload::Result<std::monostate, std::string> GitPluginSource::installSource() {
-        std::string command = "git clone " + m_sUrl + " " + m_pSourcePath.string();
+        std::string path = m_pSourcePath.string();
+        std::string command;
 
-        if (m_sBranch.has_value()) {
-            command += " --branch " + m_sBranch.value();
+        if (usesMirror()) {
+            // Checked out straight away, so the blobs of nothing else are needed
+            std::string checkout = m_sRev.value_or(
+                lock::findSourceRevision(getIdentifier()).value_or(m_sBranch.value_or("HEAD")));
+
+            auto result = syncMirror(false, checkout);
+
+            if (result.isErr()) {
+                return result;
+            }
+
+            // Borrow the mirror's objects instead of copying them
+            command = "git clone --shared --no-checkout " + getMirrorPath().string() + " " + path;
+
+            if (m_sBranch.has_value()) {
+                command += " --branch " + m_sBranch.value();
+            }
+
+            if (!m_vSparsePaths.empty()) {
+                command += " --sparse";
+            }
+
+            // The mirror fetched the blobs of the checkout. Any others, like files next to the
+            // sparse paths, are fetched from the url itself when they are checked out.
+            command += " && git -C " + path + " remote add upstream " + m_sUrl + " && git -C " +
+                path + " config remote.upstream.promisor true && git -C " + path +
+                " config remote.upstream.partialclonefilter blob:none && git -C " + path +
+                " config core.repositoryformatversion 1 && git -C " + path +
+                " config extensions.partialClone upstream && git -C " + path + " reset --hard " +
+                checkout;
+        } else if (m_eFetchStrategy == FETCH_SHALLOW && m_sRev.has_value()) {
+            // A clone can't ask for a single commit, so fetch it into an empty repo
+            command = "git init " + path + " && git -C " + path + " remote add origin " + m_sUrl;
+        } else {
+            command = "git clone " + m_sUrl + " " + path;
+
+            if (m_sBranch.has_value()) {
+                command += " --branch " + m_sBranch.value();
+            }
+
+            if (m_eFetchStrategy == FETCH_SHALLOW) {
+                command += " --depth 1";
+            }
+
+            // Sparse checkouts only save bandwidth if blobs outside of them are not fetched
+            if (m_eFetchStrategy == FETCH_PARTIAL || !m_vSparsePaths.empty()) {
+                command += " --filter=blob:none";
+            }
+
+            if (!m_vSparsePaths.empty()) {
+                command += " --sparse";
+            }
         }
 
-        if (std::system(command.c_str()) != 0) {
+        auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+        if (exit != 0) {
             return hyprload::Result<std::monostate, std::string>::err(
-                "Failed to clone plugin source");
+                "Failed to clone plugin source: " + output);
         }
 
-        if (m_sRev.has_value()) {
-            command = "git -C " + m_pSourcePath.string() + " checkout " + m_sRev.value();
+        if (!m_vSparsePaths.empty()) {
+            auto result = applySparseCheckout();
 
-            if (std::system(command.c_str()) != 0) {
+            if (result.isErr()) {
+                return result;
+            }
+        }
+
+        if (m_eFetchStrategy == FETCH_SHALLOW && m_sRev.has_value()) {
+            command = "git -C " + path + " fetch --depth 1" +
+                (m_vSparsePaths.empty() ? "" : " --filter=blob:none") + " origin " +
+                m_sRev.value() + " && git -C " + path + " checkout FETCH_HEAD";
+
+            auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+            if (exit != 0) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to fetch revision: " + output);
+            }
+        } else if (m_sRev.has_value()) {
+            command = "git -C " + path + " checkout " + m_sRev.value();
+
+            auto [exit, output] = executeCommand(command);
+
+            if (exit != 0) {
                 return hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to checkout revision");
+                    "Failed to checkout revision: " + output);
+            }
+        } else if (std::optional<std::string> locked = lock::findSourceRevision(getIdentifier())) {
+            // Reproduce what the lockfile was written from, updating moves it forward
+            std::string revision = locked.value();
+
+            command = "git -C " + path + " cat-file -e " + revision + "^{commit} || git -C " +
+                path + " fetch" + (m_eFetchStrategy == FETCH_SHALLOW ? " --depth 1" : "") +
+                " origin " + revision;
+            command += " && git -C " + path + " reset --hard " + revision;
+
+            auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+            if (exit != 0) {
+                debug("Failed to checkout locked revision " + revision + ": " + output);
             }
         }
 
         return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
     }
 
-    bool GitPluginSource::isSourceAvailable() {
-        return std::filesystem::exists(m_pSourcePath / ".git");
+    bool GitPluginSource::usesMirror() const {
+        return isGitMirrorsEnabled() && m_eFetchStrategy != FETCH_SHALLOW;
     }
 
-    bool GitPluginSource::isUpToDate() {
-        if (m_sRev.has_value()) {
-            std::string command = "git -C " + m_pSourcePath.string() + " rev-parse HEAD";
+    bool GitPluginSource::isMirrorCheckout() const {
+        // Checkouts made before mirrors were enabled still fetch from the url themselves
+        return usesMirror() &&
+            std::filesystem::exists(m_pSourcePath / ".git" / "objects" / "info" / "alternates");
+    }
 
-            auto [exit, output] = executeCommand(command);
+    std::filesystem::path GitPluginSource::getMirrorPath() const {
+        // The url hash keeps forks with the same repo name apart
+        std::string name = m_sUrl.substr(m_sUrl.find_last_of('/') + 1);
+        name = name.substr(0, name.find_last_of('.'));
+
+        return getPluginMirrorsPath() / (name + "-" + hash::sha256(m_sUrl).substr(0, 12) + ".git");
+    }
+
+    hyprload::Result<std::monostate, std::string>
+    GitPluginSource::syncMirror(bool fetch, const std::string& checkout) {
+        static std::mutex mirrorsMutex;
+        static std::unordered_map<std::string, std::shared_ptr<std::mutex>> mirrorMutexes;
+
+        std::filesystem::path mirrorPath = getMirrorPath();
+
+        std::shared_ptr<std::mutex> mirrorMutex;
+        {
+            auto lock = std::scoped_lock<std::mutex>(mirrorsMutex);
+            auto& entry = mirrorMutexes[mirrorPath.string()];
+
+            if (!entry) {
+                entry = std::make_shared<std::mutex>();
+            }
+
+            mirrorMutex = entry;
+        }
+
+        // Variants of one url sync the same mirror, one at a time
+        auto lock = std::scoped_lock<std::mutex>(*mirrorMutex);
+
+        if (!std::filesystem::exists(mirrorPath)) {
+            std::string command = "git clone --mirror " + m_sUrl + " " + mirrorPath.string();
+
+            // Keep the fetch strategy, the checkouts fetch the blobs they need themselves
+            if (m_eFetchStrategy == FETCH_PARTIAL || !m_vSparsePaths.empty()) {
+                command += " --filter=blob:none";
+            }
+
+            command += " && git -C " + mirrorPath.string() + " config gc.pruneExpire never";
+
+            auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+            if (exit != 0) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to mirror plugin source: " + output);
+            }
+
+            fetchMirrorBlobs(checkout);
+
+            return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        }
+
+        // A pinned revision the mirror already has needs no network at all
+        if (!fetch && m_sRev.has_value()) {
+            std::string command = "git -C " + mirrorPath.string() + " cat-file -e " +
+                m_sRev.value() + "^{commit}";
+
+            fetch = std::get<0>(executeCommand(command)) != 0;
+        }
+
+        if (fetch) {
+            std::string command = "git -C " + mirrorPath.string() + " remote update --prune";
+
+            auto [exit, output] = executeCommand(command, getNetworkTimeout());
 
             if (exit != 0) {
-                return false;
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to update plugin source mirror: " + output);
+            }
+        }
+
+        fetchMirrorBlobs(checkout);
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    void GitPluginSource::fetchMirrorBlobs(const std::string& checkout) {
+        std::string mirror = "git -C " + getMirrorPath().string();
+
+        // Cone mode checks out the files at the root as well as the sparse paths
+        std::string listBlobs = mirror + " ls-tree -r " + checkout;
+
+        if (!m_vSparsePaths.empty()) {
+            listBlobs = "{ " + mirror + " ls-tree " + checkout + " && " + listBlobs + " --";
+
+            for (const auto& path : m_vSparsePaths) {
+                listBlobs += " \"" + path + "\"";
+            }
+
+            listBlobs += "; }";
+        }
+
+        // Only blob-less mirrors lack blobs. Fetching them by id skips those already there, so
+        // this only goes to the network for blobs no checkout needed before.
+        std::string command = "! " + mirror + " config remote.origin.promisor > /dev/null || { " +
+            mirror + " rev-parse -q --verify " + checkout + "^{commit} > /dev/null && " +
+            listBlobs + " | awk '$2 == \"blob\" { print $3 }' | " + mirror +
+            " fetch -q --no-tags --no-write-fetch-head --filter=blob:none --stdin origin; }";
+
+        auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+        // The checkout still fetches what it lacks itself, just not shared
+        if (exit != 0) {
+            debug("Failed to fetch blobs into the mirror: " + output);
+        }
+    }
+
+    hyprload::Result<std::monostate, std::string> GitPluginSource::applySparseCheckout() {
+        // hyprload.toml sits at the root, which cone mode always checks out
+        std::string command = "git -C " + m_pSourcePath.string() + " sparse-checkout set --cone";
+
+        for (const auto& path : m_vSparsePaths) {
+            command += " \"" + path + "\"";
+        }
+
+        auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+        if (exit != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to set up sparse checkout: " + output);
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    void GitPluginSource::mergeSparsePaths(const GitPluginSource& other) {
+        if (m_vSparsePaths.empty() || other.m_vSparsePaths.empty()) {
+            m_vSparsePaths.clear();
+            return;
+        }
+
+        for (const auto& path : other.m_vSparsePaths) {
+            if (std::find(m_vSparsePaths.begin(), m_vSparsePaths.end(), path) ==
+                m_vSparsePaths.end()) {
+                m_vSparsePaths.push_back(path);
             }
+        }
+    }
+
+    bool GitPluginSource::isSourceAvailable() {
+        return std::filesystem::exists(m_pSourcePath / ".git");
+    }
+
+    bool GitPluginSource::isUpToDate() {
+        // The lockfile knows what was last installed, so git only gets asked without one
+        std::optional<std::string> localRevision = lock::findSourceRevision(getIdentifier());
 
-            return output == m_sRev.value();
+        if (localRevision.has_value() && m_sRev.has_value() &&
+            localRevision.value().starts_with(m_sRev.value())) {
+            return true;
         }
 
-        std::string command = "git -C " + m_pSourcePath.string() + " remote update";
+        if (!localRevision.has_value()) {
+            localRevision = getLocalRevision(m_pSourcePath, "HEAD");
+        }
 
-        if (std::system(command.c_str()) != 0) {
+        if (!localRevision.has_value()) {
             return false;
         }
 
-        command = "git -C " + m_pSourcePath.string() + " status -uno";
+        if (m_sRev.has_value()) {
+            // The pin may be abbreviated or a tag, so compare what it resolves to
+            return getLocalRevision(m_pSourcePath, m_sRev.value()) == localRevision;
+        }
 
-        auto [exit, output] = executeCommand(command);
+        // Ask the url itself, a mirror checkout's origin only knows what was last fetched
+        std::string ref = m_sBranch.has_value() ? "refs/heads/" + m_sBranch.value() : "HEAD";
 
-        return exit != 0 && output.find("behind") == std::string::npos;
+        return getRemoteRevision(m_sUrl, ref) == localRevision;
     }
 
     bool GitPluginSource::providesPlugin(const std::string& name) const {
@@ -290,80 +799,116 @@ namespace hyprload::plugin {
         return true;
     }
 
-    hyprload::Result<std::monostate, std::string> GitPluginSource::update(const std::string& name) {
+    hyprload::Result<std::monostate, std::string> GitPluginSource::updateSource() {
+        if (isMirrorCheckout()) {
+            auto result = syncMirror(true, m_sRev.value_or(m_sBranch.value_or("HEAD")));
+
+            if (result.isErr()) {
+                return result;
+            }
+        }
+
+        if (!m_vSparsePaths.empty()) {
+            // Another requirement may have added paths since the source was cloned
+            auto result = applySparseCheckout();
+
+            if (result.isErr()) {
+                return result;
+            }
+        }
+
+        if (m_eFetchStrategy == FETCH_SHALLOW) {
+            // Shallow clones have no history to pull onto, so move straight to the new tip
+            std::string ref = m_sRev.value_or(m_sBranch.value_or("HEAD"));
+
+            std::string command = "git -C " + m_pSourcePath.string() + " fetch --depth 1" +
+                (m_vSparsePaths.empty() ? "" : " --filter=blob:none") + " origin " + ref +
+                " && git -C " + m_pSourcePath.string() + " reset --hard FETCH_HEAD";
+
+            auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+            if (exit != 0) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Failed to update plugin source: " + output);
+            }
+
+            return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        }
+
         if (m_sRev.has_value()) {
             std::string command =
                 "git -C " + m_pSourcePath.string() + " checkout " + m_sRev.value();
 
-            if (std::system(command.c_str()) != 0) {
+            auto [exit, output] = executeCommand(command);
+
+            if (exit != 0) {
                 return hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to checkout revision");
+                    "Failed to checkout revision: " + output);
             }
 
-            return this->install(name);
+            return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
         }
 
         if (m_sBranch.has_value()) {
             std::string command =
                 "git -C " + m_pSourcePath.string() + " checkout " + m_sBranch.value();
 
-            if (std::system(command.c_str()) != 0) {
+            auto [exit, output] = executeCommand(command);
+
+            if (exit != 0) {
                 return hyprload::Result<std::monostate, std::string>::err(
-                    "Failed to checkout branch");
+                    "Failed to checkout branch: " + output);
             }
         }
 
         std::string command = "git -C " + m_pSourcePath.string() + " pull";
 
-        if (std::system(command.c_str()) != 0) {
+        auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+        if (exit != 0) {
             return hyprload::Result<std::monostate, std::string>::err(
-                "Failed to update plugin source");
+                "Failed to update plugin source: " + output);
         }
 
-        return this->install(name);
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
     }
 
-    hyprload::Result<std::monostate, std::string>
-    GitPluginSource::install(const std::string& name) {
-        if (!this->isSourceAvailable()) {
-            return this->installSource();
-        }
-
-        auto result = build(name);
+    hyprload::Result<std::monostate, std::string> GitPluginSource::update(const std::string& name) {
+        auto result = updateSource();
 
         if (result.isErr()) {
             return result;
         }
 
-        auto pluginManifestResult = getPluginManifest(m_pSourcePath, name);
-
-        if (pluginManifestResult.isErr()) {
-            return hyprload::Result<std::monostate, std::string>::err(
-                pluginManifestResult.unwrapErr());
-        }
-
-        auto pluginManifest = pluginManifestResult.unwrap();
+        return this->install(name);
+    }
 
-        std::filesystem::path outputBinary = m_pSourcePath / pluginManifest.getBinaryOutputPath();
+    hyprload::Result<std::monostate, std::string>
+    GitPluginSource::install(const std::string& name) {
+        if (!this->isSourceAvailable()) {
+            auto result = this->installSource();
 
-        if (!std::filesystem::exists(outputBinary)) {
-            return hyprload::Result<std::monostate, std::string>::err(
-                "Plugin binary does not exist");
+            if (result.isErr()) {
+                return result;
+            }
         }
 
-        std::filesystem::path targetPath = hyprload::getPluginBinariesPath() / (name + ".so");
+        auto result = build(name);
 
-        if (std::filesystem::exists(targetPath)) {
-            std::filesystem::remove(targetPath);
+        if (result.isErr()) {
+            return result;
         }
 
-        std::filesystem::copy(outputBinary, targetPath);
+        return deploy(name);
+    }
 
-        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    hyprload::Result<std::monostate, std::string>
+    GitPluginSource::deploy(const std::string& name) {
+        return deployPlugin(m_pSourcePath, name, getRevision());
     }
 
     hyprload::Result<std::monostate, std::string> GitPluginSource::build(const std::string& name) {
-        return buildPlugin(m_pSourcePath, name);
+        return buildPlugin(m_pSourcePath, name, getRevision());
     }
 
     bool GitPluginSource::isEquivalent(const PluginSource& other) const {
@@ -375,17 +920,41 @@ namespace hyprload::plugin {
 
     LocalPluginSource::LocalPluginSource(std::filesystem::path&& path) : m_pSourcePath(path) {}
 
+    std::string LocalPluginSource::getIdentifier() const {
+        return m_pSourcePath.string();
+    }
+
+    std::optional<std::string> LocalPluginSource::getRevision() const {
+        return std::nullopt; // Local sources are not versioned
+    }
+
+    std::filesystem::path LocalPluginSource::getSourcePath() const {
+        return m_pSourcePath;
+    }
+
     hyprload::Result<std::monostate, std::string> LocalPluginSource::installSource() {
         return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
     }
 
+    hyprload::Result<std::monostate, std::string> LocalPluginSource::updateSource() {
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
     bool LocalPluginSource::isSourceAvailable() {
         return std::filesystem::exists(m_pSourcePath);
     }
 
     bool LocalPluginSource::isUpToDate() {
-        return false; // Always update local plugins, since they are not versioned
-                      // and we don't know if they have changed.
+        // Local plugins are not versioned, so compare the tree with what was last built
+        std::vector<std::string> names;
+
+        for (const auto& requirement : config::g_pHyprloadConfig->getPlugins()) {
+            if (requirement.getSource().get() == this) {
+                names.push_back(requirement.getName());
+            }
+        }
+
+        return index::isSourceUnchanged(m_pSourcePath, names);
     }
 
     bool LocalPluginSource::providesPlugin(const std::string& name) const {
@@ -416,36 +985,30 @@ namespace hyprload::plugin {
             return result;
         }
 
-        auto pluginManifestResult = getPluginManifest(m_pSourcePath, name);
-
-        if (pluginManifestResult.isErr()) {
-            return hyprload::Result<std::monostate, std::string>::err(
-                pluginManifestResult.unwrapErr());
-        }
-
-        const auto& pluginManifest = pluginManifestResult.unwrap();
-
-        std::filesystem::path outputBinary = m_pSourcePath / pluginManifest.getBinaryOutputPath();
-
-        if (!std::filesystem::exists(outputBinary)) {
-            return hyprload::Result<std::monostate, std::string>::err(
-                "Plugin binary does not exist");
-        }
-
-        std::filesystem::path targetPath = hyprload::getPluginBinariesPath() / (name + ".so");
+        return deploy(name);
+    }
 
-        if (std::filesystem::exists(targetPath)) {
-            std::filesystem::remove(targetPath);
-        }
+    hyprload::Result<std::monostate, std::string>
+    LocalPluginSource::deploy(const std::string& name) {
+        auto result = deployPlugin(m_pSourcePath, name, getRevision());
 
-        std::filesystem::copy(outputBinary, targetPath);
+        // Taken after the build, so whatever it wrote into the tree counts as unchanged
+        index::recordBuild(m_pSourcePath, name,
+                           result.isOk() ? index::getSourceFingerprint(m_pSourcePath)
+                                         : std::nullopt);
 
-        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        return result;
     }
 
     hyprload::Result<std::monostate, std::string>
     LocalPluginSource::build(const std::string& name) {
-        return buildPlugin(m_pSourcePath, name);
+        auto result = buildPlugin(m_pSourcePath, name, getRevision());
+
+        if (result.isErr()) {
+            index::recordBuild(m_pSourcePath, name, std::nullopt);
+        }
+
+        return result;
     }
 
     bool LocalPluginSource::isEquivalent(const PluginSource& other) const {
@@ -456,12 +1019,27 @@ namespace hyprload::plugin {
 
     SelfSource::SelfSource() {}
 
+    std::string SelfSource::getIdentifier() const {
+        return "hyprload";
+    }
+
+    std::optional<std::string> SelfSource::getRevision() const {
+        return std::nullopt; // Never cached, make install puts it in place itself
+    }
+
+    std::filesystem::path SelfSource::getSourcePath() const {
+        return getRootPath() / "src";
+    }
+
     hyprload::Result<std::monostate, std::string> SelfSource::installSource() {
-        std::string command = "git clone https://github.com/Duckonaut/hyprload.git " +
-            getRootPath().string() + "/src";
+        std::string command =
+            "git clone " + c_selfSourceUrl + " " + (getRootPath() / "src").string();
+
+        auto [exit, output] = executeCommand(command, getNetworkTimeout());
 
-        if (std::system(command.c_str()) != 0) {
-            return hyprload::Result<std::monostate, std::string>::err("Failed to clone own source");
+        if (exit != 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to clone own source: " + output);
         }
 
         return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
@@ -472,30 +1050,38 @@ namespace hyprload::plugin {
     }
 
     bool SelfSource::isUpToDate() {
-        std::filesystem::path sourcePath = getRootPath() / "src";
-        std::string command = "git -C " + sourcePath.string() + " remote update";
+        std::optional<std::string> localRevision =
+            getLocalRevision(getRootPath() / "src", "HEAD");
 
-        if (std::system(command.c_str()) != 0) {
+        if (!localRevision.has_value()) {
             return false;
         }
 
-        command = "git -C " + sourcePath.string() + " status -uno";
-
-        auto [exit, output] = executeCommand(command);
-
-        return exit != 0 && output.find("behind") == std::string::npos;
+        return getRemoteRevision(c_selfSourceUrl, "HEAD") == localRevision;
     }
 
     bool SelfSource::providesPlugin(const std::string&) const {
         return false; // Don't provide any plugins.
     }
 
-    hyprload::Result<std::monostate, std::string> SelfSource::update(const std::string& name) {
+    hyprload::Result<std::monostate, std::string> SelfSource::updateSource() {
         std::string command = "git -C " + (getRootPath() / "src").string() + " pull";
 
-        if (std::system(command.c_str()) != 0) {
+        auto [exit, output] = executeCommand(command, getNetworkTimeout());
+
+        if (exit != 0) {
             return hyprload::Result<std::monostate, std::string>::err(
-                "Failed to update own source");
+                "Failed to update own source: " + output);
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    hyprload::Result<std::monostate, std::string> SelfSource::update(const std::string& name) {
+        auto result = updateSource();
+
+        if (result.isErr()) {
+            return result;
         }
 
         return this->install(name);
@@ -503,7 +1089,11 @@ namespace hyprload::plugin {
 
     hyprload::Result<std::monostate, std::string> SelfSource::install(const std::string& name) {
         if (!this->isSourceAvailable()) {
-            return this->installSource();
+            auto result = this->installSource();
+
+            if (result.isErr()) {
+                return result;
+            }
         }
 
         auto result = build(name);
@@ -512,16 +1102,21 @@ namespace hyprload::plugin {
             return result;
         }
 
+        return deploy(name);
+    }
+
+    hyprload::Result<std::monostate, std::string> SelfSource::deploy(const std::string&) {
+        // make install already put the binary in place
         return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
     }
 
     hyprload::Result<std::monostate, std::string> SelfSource::build(const std::string&) {
-        std::string buildSteps =
+        std::string buildSteps = getJobserverExports() +
             "export HYPRLAND_COMMIT=" + g_pHyprload->getCurrentHyprlandCommitHash() +
             " && export PKG_CONFIG_PATH=" + getPkgConfigOverridePath().string() + " && make -C " +
             (getRootPath() / "src").string() + " install";
 
-        auto [exit, output] = executeCommand(buildSteps);
+        auto [exit, output] = executeCommand(buildSteps, std::nullopt, true);
 
         if (exit != 0) {
             return hyprload::Result<std::monostate, std::string>::err("Failed to build self: " +
@@ -554,13 +1149,43 @@ namespace hyprload::plugin {
                 rev = plugin["rev"].as_string()->get();
             }
 
-            auto gitSource = std::make_shared<GitPluginSource>(std::string(source),
-                                                               std::move(branch), std::move(rev));
+            eFetchStrategy fetchStrategy = FETCH_PARTIAL;
+
+            if (plugin.contains("fetch") && plugin["fetch"].is_string()) {
+                const std::string& fetch = plugin["fetch"].as_string()->get();
+
+                if (fetch == "full") {
+                    fetchStrategy = FETCH_FULL;
+                } else if (fetch == "partial") {
+                    fetchStrategy = FETCH_PARTIAL;
+                } else if (fetch == "shallow") {
+                    fetchStrategy = FETCH_SHALLOW;
+                } else {
+                    throw std::runtime_error("Unknown fetch strategy " + fetch);
+                }
+            }
+
+            std::vector<std::string> sparsePaths = std::vector<std::string>();
+
+            if (plugin.contains("sparse") && plugin["sparse"].is_array()) {
+                plugin["sparse"].as_array()->for_each([&sparsePaths](const toml::node& value) {
+                    if (!value.is_string()) {
+                        throw std::runtime_error("Sparse path must be a string");
+                    }
+                    sparsePaths.push_back(value.as_string()->get());
+                });
+            }
+
+            auto gitSource = std::make_shared<GitPluginSource>(
+                std::string(source), std::move(branch), std::move(rev), fetchStrategy,
+                std::move(sparsePaths));
 
             // Deduplicate sources
             bool found = false;
             for (const auto& pluginSource : g_vPluginSources) {
                 if (*pluginSource == *gitSource) {
+                    std::static_pointer_cast<GitPluginSource>(pluginSource)
+                        ->mergeSparsePaths(*gitSource);
                     m_pSource = pluginSource;
                     found = true;
                     break;
@@ -599,6 +1224,10 @@ namespace hyprload::plugin {
             m_sName = source.substr(source.find_last_of('/') + 1);
         }
 
+        if (plugin.contains("lazy") && plugin["lazy"].is_boolean()) {
+            m_bLazy = plugin["lazy"].as_boolean()->get();
+        }
+
         m_pBinaryPath = hyprload::getPluginBinariesPath() / (m_sName + ".so");
     }
 
@@ -641,4 +1270,8 @@ namespace hyprload::plugin {
     bool PluginRequirement::isInstalled() const {
         return std::filesystem::exists(m_pBinaryPath);
     }
+
+    bool PluginRequirement::isLazy() const {
+        return m_bLazy;
+    }
 }
@@ -0,0 +1,337 @@
+#include "InstallTransaction.hpp"
+#include "Hash.hpp"
+#include "Janitor.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hyprload::install {
+    // A binary moved into the store has a single link until it is linked into its generation,
+    // so the sweep on the janitor can't run in between
+    static std::mutex g_mStoreMutex;
+
+    static void syncPath(const std::filesystem::path& path) {
+        fd_t fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    // Generations can be large trees, leave them to the janitor when it is there. Renamed first,
+    // so a half removed generation is never mistaken for one to roll back to.
+    static void removeGeneration(const std::filesystem::path& generationPath) {
+        std::filesystem::path removedPath = generationPath;
+        removedPath += ".removed";
+
+        std::error_code ec;
+        std::filesystem::rename(generationPath, removedPath, ec);
+
+        if (ec) {
+            return;
+        }
+
+        if (g_pJanitor) {
+            g_pJanitor->removeTree(removedPath);
+            return;
+        }
+
+        std::filesystem::remove_all(removedPath, ec);
+    }
+
+    static void removeUnusedBinaries() {
+        auto lock = std::scoped_lock<std::mutex>(g_mStoreMutex);
+        std::error_code ec;
+
+        // A stored binary no generation, session or cache links to is only linked from here
+        for (const auto& entry : std::filesystem::directory_iterator(getPluginStorePath(), ec)) {
+            struct stat binaryStat;
+
+            if (entry.path().extension() == ".so" && stat(entry.path().c_str(), &binaryStat) == 0 &&
+                binaryStat.st_nlink == 1) {
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+
+        // Lock records of the binaries that are gone
+        for (const auto& entry : std::filesystem::directory_iterator(getPluginStorePath(), ec)) {
+            std::filesystem::path binary = entry.path();
+
+            if (binary.extension() == ".toml" &&
+                !std::filesystem::exists(binary.replace_extension(".so"), ec)) {
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    static std::filesystem::path getGenerationPath(u64 generation) {
+        return getPluginGenerationsPath() / std::to_string(generation);
+    }
+
+    static std::vector<u64> listGenerations() {
+        std::vector<u64> generations;
+        std::error_code ec;
+
+        for (const auto& entry :
+             std::filesystem::directory_iterator(getPluginGenerationsPath(), ec)) {
+            std::string filename = entry.path().filename();
+
+            if (!filename.empty() && std::all_of(filename.begin(), filename.end(), ::isdigit)) {
+                generations.push_back(std::stoull(filename));
+            }
+        }
+
+        std::sort(generations.begin(), generations.end());
+
+        return generations;
+    }
+
+    // Point plugins/bin at the generation, replacing the symlink rather than changing it
+    static hyprload::Result<std::monostate, std::string> switchGeneration(u64 generation) {
+        std::filesystem::path binariesPath = getPluginBinariesPath();
+        std::filesystem::path temporary = binariesPath;
+        temporary += ".tmp";
+
+        std::error_code ec;
+        std::filesystem::remove(temporary, ec);
+        std::filesystem::create_directory_symlink(getGenerationPath(generation), temporary, ec);
+
+        if (ec) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to create generation link: " + ec.message());
+        }
+
+        if (!std::filesystem::is_symlink(binariesPath, ec) &&
+            std::filesystem::is_directory(binariesPath, ec)) {
+            // Binaries from before generations, only once. They were carried over already.
+            std::filesystem::remove_all(binariesPath, ec);
+        }
+
+        std::filesystem::rename(temporary, binariesPath, ec);
+
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to switch to generation " + std::to_string(generation) + ": " +
+                ec.message());
+        }
+
+        syncPath(binariesPath.parent_path());
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    std::filesystem::path getStagedBinaryPath(const std::string& name) {
+        return getPluginStagingPath() / (name + ".so");
+    }
+
+    std::optional<u64> getCurrentGeneration() {
+        std::error_code ec;
+        std::filesystem::path target = std::filesystem::read_symlink(getPluginBinariesPath(), ec);
+
+        if (ec) {
+            return std::nullopt;
+        }
+
+        std::string filename = target.filename();
+
+        if (filename.empty() || !std::all_of(filename.begin(), filename.end(), ::isdigit)) {
+            return std::nullopt;
+        }
+
+        return std::stoull(filename);
+    }
+
+    hyprload::Result<std::monostate, std::string>
+    commitBinaries(const std::vector<std::string>& plugins,
+                   const std::vector<std::string>& removed) {
+        // Requirements sharing a plugin each report it
+        std::vector<std::string> staged = plugins;
+        std::sort(staged.begin(), staged.end());
+        staged.erase(std::unique(staged.begin(), staged.end()), staged.end());
+
+        for (const auto& name : staged) {
+            if (!std::filesystem::exists(getStagedBinaryPath(name))) {
+                return hyprload::Result<std::monostate, std::string>::err(
+                    "Nothing staged for " + name);
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(getPluginStorePath(), ec);
+        std::filesystem::create_directories(getPluginGenerationsPath(), ec);
+
+        std::vector<u64> generations = listGenerations();
+        u64 generation = generations.empty() ? 1 : generations.back() + 1;
+        std::filesystem::path generationPath = getGenerationPath(generation);
+
+        std::filesystem::create_directory(generationPath, ec);
+
+        if (ec) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to create generation " + std::to_string(generation) + ": " +
+                ec.message());
+        }
+
+        auto fail = [&generationPath](const std::string& message) {
+            std::error_code ec;
+            std::filesystem::remove_all(generationPath, ec);
+
+            return hyprload::Result<std::monostate, std::string>::err(std::string(message));
+        };
+
+        // Carry over everything that isn't being replaced or removed
+        for (const auto& entry :
+             std::filesystem::directory_iterator(getPluginBinariesPath(), ec)) {
+            std::string filename = entry.path().filename();
+            std::string name = filename.substr(0, filename.find(".so"));
+
+            if (filename.find(".so") == std::string::npos ||
+                std::binary_search(staged.begin(), staged.end(), name) ||
+                std::find(removed.begin(), removed.end(), name) != removed.end()) {
+                continue;
+            }
+
+            // The same inode, so loaded plugins that didn't change aren't reloaded
+            if (link(entry.path().c_str(), (generationPath / filename).c_str()) != 0) {
+                return fail("Failed to carry " + name + " over to generation " +
+                            std::to_string(generation) + ": " + strerror(errno));
+            }
+        }
+
+        {
+            auto lock = std::scoped_lock<std::mutex>(g_mStoreMutex);
+
+            for (const auto& name : staged) {
+                std::filesystem::path binary = getStagedBinaryPath(name);
+                std::optional<std::string> digest = hash::sha256File(binary);
+
+                if (!digest.has_value()) {
+                    return fail("Failed to read staged binary of " + name);
+                }
+
+                std::filesystem::path stored = getPluginStorePath() / (digest.value() + ".so");
+
+                // Flush before anything refers to it, a crash must not leave an empty binary
+                if (!std::filesystem::exists(stored)) {
+                    syncPath(binary);
+                    std::filesystem::rename(binary, stored, ec);
+
+                    if (ec) {
+                        return fail("Failed to store " + name + ": " + ec.message());
+                    }
+                } else {
+                    std::filesystem::remove(binary, ec);
+                }
+
+                if (link(stored.c_str(), (generationPath / (name + ".so")).c_str()) != 0) {
+                    return fail("Failed to add " + name + " to generation " +
+                                std::to_string(generation) + ": " + strerror(errno));
+                }
+            }
+        }
+
+        syncPath(getPluginStorePath());
+        syncPath(generationPath);
+
+        auto result = switchGeneration(generation);
+
+        if (result.isErr()) {
+            return fail(result.unwrapErr());
+        }
+
+        debug("Switched to generation " + std::to_string(generation));
+
+        collectGenerations();
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    hyprload::Result<u64, std::string> rollback() {
+        std::optional<u64> current = getCurrentGeneration();
+
+        if (!current.has_value()) {
+            return hyprload::Result<u64, std::string>::err("No generation to roll back from");
+        }
+
+        std::vector<u64> generations = listGenerations();
+        auto it = std::lower_bound(generations.begin(), generations.end(), current.value());
+
+        if (it == generations.begin()) {
+            return hyprload::Result<u64, std::string>::err("No older generation to roll back to");
+        }
+
+        u64 generation = *std::prev(it);
+
+        auto result = switchGeneration(generation);
+
+        if (result.isErr()) {
+            return hyprload::Result<u64, std::string>::err(result.unwrapErr());
+        }
+
+        // Loaded plugins are linked into the session, so they outlive their generation
+        removeGeneration(getGenerationPath(current.value()));
+
+        return hyprload::Result<u64, std::string>::ok(u64(generation));
+    }
+
+    void collectRemovedGenerations() {
+        std::error_code ec;
+
+        for (const auto& entry :
+             std::filesystem::directory_iterator(getPluginGenerationsPath(), ec)) {
+            if (entry.path().extension() == ".removed") {
+                g_pJanitor->removeTree(entry.path());
+            }
+        }
+
+        // Queued after the generations, so it sees them gone
+        g_pJanitor->submit(removeUnusedBinaries);
+    }
+
+    void collectGenerations() {
+        std::optional<u64> current = getCurrentGeneration();
+        std::vector<u64> generations = listGenerations();
+
+        usize keep = getGenerationsToKeep();
+        std::optional<std::chrono::hours> maxAge = getGenerationMaxAge();
+
+        auto now = std::filesystem::file_time_type::clock::now();
+        std::error_code ec;
+
+        for (usize i = 0; i < generations.size(); i++) {
+            u64 generation = generations[i];
+
+            if (generation == current) {
+                continue;
+            }
+
+            std::filesystem::path generationPath = getGenerationPath(generation);
+
+            bool tooMany = generations.size() - i > keep;
+            bool tooOld = maxAge.has_value() &&
+                now - std::filesystem::last_write_time(generationPath, ec) > maxAge.value();
+
+            if (tooMany || tooOld) {
+                debug("Removing generation " + std::to_string(generation));
+                removeGeneration(generationPath);
+            }
+        }
+
+        // Queued after the generations, so it sees them gone
+        if (g_pJanitor) {
+            g_pJanitor->submit(removeUnusedBinaries);
+        } else {
+            removeUnusedBinaries();
+        }
+    }
+}
@@ -0,0 +1,186 @@
+#include "Janitor.hpp"
+#include "util.hpp"
+
+#include <chrono>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hyprload {
+    static const usize c_batchSize = 64;
+    static const auto c_batchPause = std::chrono::milliseconds(5);
+    // A session without a lock may be one another instance is still creating
+    static const auto c_unlockedSessionAge = std::chrono::minutes(1);
+
+    Janitor::Janitor() {
+        m_tThread = std::thread([this]() { run(); });
+    }
+
+    Janitor::~Janitor() {
+        // Queued removals are dropped rather than drained, so unloading doesn't wait on them.
+        // Sessions and generations left behind are removed again by the next start.
+        {
+            auto lock = std::scoped_lock<std::mutex>(m_mMutex);
+            m_bStopping = true;
+        }
+
+        m_cvTasks.notify_all();
+        m_tThread.join();
+    }
+
+    void Janitor::removeTree(const std::filesystem::path& path) {
+        submit([this, path]() {
+            fd_t parentFd = open(path.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+            if (parentFd < 0) {
+                return;
+            }
+
+            removeEntry(parentFd, path.filename().c_str(), true);
+            close(parentFd);
+        });
+    }
+
+    void Janitor::removeStaleSessions(const std::optional<std::filesystem::path>& currentSession) {
+        submit([this, currentSession]() {
+            std::error_code ec;
+
+            for (const auto& entry :
+                 std::filesystem::directory_iterator(getPluginsPath(), ec)) {
+                if (m_bStopping) {
+                    return;
+                }
+
+                std::string sessionPath = entry.path().filename();
+
+                if (sessionPath.find("session.") == std::string::npos ||
+                    entry.path() == currentSession) {
+                    continue;
+                }
+
+                fd_t lockFd = open((entry.path() / "lock").c_str(), O_RDWR | O_CLOEXEC);
+
+                if (lockFd < 0) {
+                    auto modified = std::filesystem::last_write_time(entry.path(), ec);
+
+                    if (ec ||
+                        std::filesystem::file_time_type::clock::now() - modified <
+                            c_unlockedSessionAge) {
+                        continue;
+                    }
+                } else if (flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+                    // Another instance is running with it
+                    close(lockFd);
+                    continue;
+                }
+
+                // Holding the lock while removing, so nothing else takes the session for live
+                fd_t parentFd =
+                    open(getPluginsPath().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+                if (parentFd >= 0) {
+                    removeEntry(parentFd, sessionPath.c_str(), true);
+                    close(parentFd);
+                }
+
+                if (lockFd >= 0) {
+                    close(lockFd);
+                }
+            }
+        });
+    }
+
+    void Janitor::submit(std::function<void()>&& task) {
+        {
+            auto lock = std::scoped_lock<std::mutex>(m_mMutex);
+            m_dTasks.push_back(std::move(task));
+        }
+
+        m_cvTasks.notify_one();
+    }
+
+    void Janitor::run() {
+        while (true) {
+            std::function<void()> task;
+
+            {
+                auto lock = std::unique_lock<std::mutex>(m_mMutex);
+                m_cvTasks.wait(lock, [this]() { return m_bStopping || !m_dTasks.empty(); });
+
+                if (m_bStopping) {
+                    return;
+                }
+
+                task = std::move(m_dTasks.front());
+                m_dTasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    void Janitor::removeContents(fd_t directoryFd) {
+        // fdopendir takes ownership, keep the caller's fd for unlinkat
+        fd_t iteratorFd = dup(directoryFd);
+        DIR* directory = iteratorFd >= 0 ? fdopendir(iteratorFd) : nullptr;
+
+        if (!directory) {
+            if (iteratorFd >= 0) {
+                close(iteratorFd);
+            }
+
+            return;
+        }
+
+        while (dirent* entry = readdir(directory)) {
+            std::string_view name = entry->d_name;
+
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            bool isDirectory = entry->d_type == DT_DIR;
+
+            if (entry->d_type == DT_UNKNOWN) {
+                struct stat entryStat;
+                isDirectory = fstatat(directoryFd, entry->d_name, &entryStat,
+                                      AT_SYMLINK_NOFOLLOW) == 0 &&
+                    S_ISDIR(entryStat.st_mode);
+            }
+
+            if (!removeEntry(directoryFd, entry->d_name, isDirectory)) {
+                break;
+            }
+        }
+
+        closedir(directory);
+    }
+
+    bool Janitor::removeEntry(fd_t directoryFd, const char* name, bool isDirectory) {
+        if (m_bStopping) {
+            return false;
+        }
+
+        if (isDirectory) {
+            fd_t childFd =
+                openat(directoryFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+            if (childFd >= 0) {
+                removeContents(childFd);
+                close(childFd);
+            }
+        }
+
+        unlinkat(directoryFd, name, isDirectory ? AT_REMOVEDIR : 0);
+
+        if (++m_iBatchRemoved >= c_batchSize) {
+            m_iBatchRemoved = 0;
+            std::this_thread::sleep_for(c_batchPause);
+        }
+
+        return !m_bStopping;
+    }
+}
@@ -0,0 +1,121 @@
+#include "Jobserver.hpp"
+#include "util.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace hyprload {
+    static bool makeSupportsFifoJobserver() {
+        auto [exit, output] = executeCommand("make --version");
+
+        if (exit != 0) {
+            return false;
+        }
+
+        int major = 0;
+        int minor = 0;
+
+        if (std::sscanf(output.c_str(), "GNU Make %d.%d", &major, &minor) != 2) {
+            return false;
+        }
+
+        return major > 4 || (major == 4 && minor >= 4);
+    }
+
+    Jobserver::Jobserver(const std::filesystem::path& fifoPath, usize slots,
+                         usize concurrentBuilds) {
+        m_pFifoPath = fifoPath;
+        m_iSlots = slots > 0 ? slots : 1;
+
+        std::filesystem::remove(m_pFifoPath);
+
+        if (mkfifo(m_pFifoPath.c_str(), 0600) != 0) {
+            debug("Failed to create jobserver fifo at " + m_pFifoPath.string());
+            return;
+        }
+
+        // Opening the read end first without blocking, then making it blocking again, since
+        // older makes do not expect a non-blocking jobserver pipe.
+        // Close-on-exec, or every program Hyprland starts would hold the jobserver open
+        m_iReadFd = open(m_pFifoPath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        m_iWriteFd = open(m_pFifoPath.c_str(), O_WRONLY | O_CLOEXEC);
+
+        if (m_iReadFd < 0 || m_iWriteFd < 0) {
+            debug("Failed to open jobserver fifo at " + m_pFifoPath.string());
+            return;
+        }
+
+        fcntl(m_iReadFd, F_SETFL, fcntl(m_iReadFd, F_GETFL) & ~O_NONBLOCK);
+
+        usize tokens = m_iSlots > concurrentBuilds ? m_iSlots - concurrentBuilds : 0;
+
+        for (usize i = 0; i < tokens; i++) {
+            if (write(m_iWriteFd, "+", 1) != 1) {
+                debug("Failed to fill jobserver, only " + std::to_string(i) + " tokens");
+                break;
+            }
+        }
+
+        m_sMakeflags = " -j" + std::to_string(m_iSlots) + " --jobserver-auth=";
+
+        if (makeSupportsFifoJobserver()) {
+            m_sMakeflags += "fifo:" + m_pFifoPath.string();
+        } else {
+            // Duplicated above both fds in the build process, so neither is overwritten first
+            m_iInheritedReadFd = std::max(m_iReadFd, m_iWriteFd) + 1;
+            m_iInheritedWriteFd = m_iInheritedReadFd + 1;
+
+            m_sMakeflags += std::to_string(m_iInheritedReadFd) + "," +
+                std::to_string(m_iInheritedWriteFd);
+        }
+
+        debug("Jobserver ready with " + std::to_string(m_iSlots) + " slots");
+    }
+
+    Jobserver::~Jobserver() {
+        if (m_iReadFd >= 0) {
+            close(m_iReadFd);
+        }
+
+        if (m_iWriteFd >= 0) {
+            close(m_iWriteFd);
+        }
+
+        std::filesystem::remove(m_pFifoPath);
+    }
+
+    void Jobserver::inheritFds(posix_spawn_file_actions_t* actions) const {
+        if (!isValid() || m_iInheritedReadFd < 0) {
+            return;
+        }
+
+        // dup2 clears close-on-exec on the copies, only in the spawned process
+        posix_spawn_file_actions_adddup2(actions, m_iReadFd, m_iInheritedReadFd);
+        posix_spawn_file_actions_adddup2(actions, m_iWriteFd, m_iInheritedWriteFd);
+    }
+
+    bool Jobserver::isValid() const {
+        return m_iReadFd >= 0 && m_iWriteFd >= 0 && !m_sMakeflags.empty();
+    }
+
+    usize Jobserver::getSlots() const {
+        return m_iSlots;
+    }
+
+    const std::string& Jobserver::getMakeflags() const {
+        return m_sMakeflags;
+    }
+
+    std::string getJobserverExports() {
+        if (!g_pJobserver || !g_pJobserver->isValid()) {
+            return "";
+        }
+
+        return "export MAKEFLAGS=\"" + g_pJobserver->getMakeflags() + "\" && ";
+    }
+}
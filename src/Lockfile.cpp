@@ -0,0 +1,218 @@
+#include "Lockfile.hpp"
+#include "Hash.hpp"
+#include "Hyprload.hpp"
+#include "HyprloadConfig.hpp"
+#include "util.hpp"
+
+#include "toml/toml.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace hyprload::lock {
+    static std::mutex g_mLockfileMutex;
+    // Plugins deployed by the running builds, by name, with everything but their binary
+    static std::unordered_map<std::string, toml::table> g_mStagedPlugins;
+
+    // Each installed binary's lock entry is kept next to it in the store, so rolling back to it
+    // can lock it again
+    static std::filesystem::path getRecordPath(const std::string& digest) {
+        return getPluginStorePath() / (digest + ".toml");
+    }
+
+    static void writeTable(const std::filesystem::path& path, const toml::table& table) {
+        std::filesystem::path temporaryPath = path;
+        temporaryPath += ".tmp";
+
+        std::ofstream stream(temporaryPath);
+        stream << table << "\n";
+        stream.close();
+
+        std::error_code ec;
+        std::filesystem::rename(temporaryPath, path, ec);
+    }
+
+    static toml::table readLockfile() {
+        std::filesystem::path lockfilePath = getLockfilePath();
+
+        if (!std::filesystem::exists(lockfilePath)) {
+            return toml::table();
+        }
+
+        try {
+            return toml::parse_file(lockfilePath.string());
+        } catch (const std::exception& e) {
+            debug("Failed to parse lockfile: " + std::string(e.what()));
+            return toml::table();
+        }
+    }
+
+    std::filesystem::path getLockfilePath() {
+        std::filesystem::path lockfilePath = config::getConfigPath();
+
+        return lockfilePath.replace_extension(".lock");
+    }
+
+    std::optional<SLockedPlugin> findPlugin(const std::string& name) {
+        toml::table lockfile;
+        {
+            auto lock = std::scoped_lock<std::mutex>(g_mLockfileMutex);
+            lockfile = readLockfile();
+        }
+
+        const toml::table* plugin = lockfile["plugins"][name].as_table();
+
+        if (!plugin) {
+            return std::nullopt;
+        }
+
+        return SLockedPlugin{
+            .m_sSource = (*plugin)["source"].value_or(std::string()),
+            .m_sRevision = (*plugin)["revision"].value<std::string>(),
+            .m_sManifestHash = (*plugin)["manifest"].value_or(std::string()),
+            .m_sBinaryHash = (*plugin)["binary"].value_or(std::string()),
+            .m_sHyprlandCommit = (*plugin)["hyprland"].value_or(std::string()),
+        };
+    }
+
+    std::optional<std::string> findSourceRevision(const std::string& identifier) {
+        toml::table lockfile;
+        {
+            auto lock = std::scoped_lock<std::mutex>(g_mLockfileMutex);
+            lockfile = readLockfile();
+        }
+
+        const toml::table* plugins = lockfile["plugins"].as_table();
+
+        if (!plugins) {
+            return std::nullopt;
+        }
+
+        std::optional<std::string> sourceRevision;
+
+        for (const auto& [name, plugin] : *plugins) {
+            const toml::table* table = plugin.as_table();
+
+            if (!table || (*table)["source"].value_or(std::string()) != identifier) {
+                continue;
+            }
+
+            std::optional<std::string> revision = (*table)["revision"].value<std::string>();
+
+            // Plugins of one source share its checkout, which can't be at two revisions
+            if (!revision.has_value() ||
+                (sourceRevision.has_value() && sourceRevision != revision)) {
+                return std::nullopt;
+            }
+
+            sourceRevision = revision;
+        }
+
+        return sourceRevision;
+    }
+
+    void stagePlugin(const std::string& name, const plugin::PluginSource& source) {
+        toml::table plugin = toml::table{
+            {"source", source.getIdentifier()},
+            {"manifest", hash::sha256File(source.getSourcePath() / "hyprload.toml").value_or("")},
+            {"hyprland", g_pHyprload->getCurrentHyprlandCommitHash()},
+        };
+
+        if (std::optional<std::string> revision = source.getRevision()) {
+            plugin.insert_or_assign("revision", revision.value());
+        }
+
+        auto lock = std::scoped_lock<std::mutex>(g_mLockfileMutex);
+
+        g_mStagedPlugins.insert_or_assign(name, std::move(plugin));
+    }
+
+    void commitPlugins(const std::vector<std::string>& committed,
+                       const std::vector<plugin::PluginRequirement>& requirements) {
+        auto lock = std::scoped_lock<std::mutex>(g_mLockfileMutex);
+
+        toml::table lockfile = readLockfile();
+        lockfile.insert_or_assign("version", 1);
+
+        if (!lockfile["plugins"].is_table()) {
+            lockfile.insert_or_assign("plugins", toml::table());
+        }
+
+        toml::table* plugins = lockfile["plugins"].as_table();
+
+        for (const auto& name : committed) {
+            auto staged = g_mStagedPlugins.extract(name);
+
+            if (staged.empty()) {
+                continue;
+            }
+
+            // The binary that is installed now, not whatever was staged last
+            std::optional<std::string> digest =
+                hash::sha256File(getPluginBinariesPath() / (name + ".so"));
+
+            if (!digest.has_value()) {
+                continue;
+            }
+
+            toml::table plugin = std::move(staged.mapped());
+            plugin.insert_or_assign("binary", digest.value());
+
+            writeTable(getRecordPath(digest.value()), plugin);
+            plugins->insert_or_assign(name, std::move(plugin));
+        }
+
+        std::vector<std::string> unwanted;
+
+        for (const auto& [name, plugin] : *plugins) {
+            if (std::none_of(requirements.begin(), requirements.end(),
+                             [&name](const plugin::PluginRequirement& requirement) {
+                                 return requirement.getName() == name.str();
+                             })) {
+                unwanted.emplace_back(name.str());
+            }
+        }
+
+        for (const auto& name : unwanted) {
+            plugins->erase(name);
+        }
+
+        writeTable(getLockfilePath(), lockfile);
+    }
+
+    void restorePlugins() {
+        toml::table plugins;
+        std::error_code ec;
+
+        for (const auto& entry :
+             std::filesystem::directory_iterator(getPluginBinariesPath(), ec)) {
+            if (entry.path().extension() != ".so") {
+                continue;
+            }
+
+            std::optional<std::string> digest = hash::sha256File(entry.path());
+
+            if (!digest.has_value() || !std::filesystem::exists(getRecordPath(digest.value()))) {
+                continue;
+            }
+
+            try {
+                plugins.insert_or_assign(entry.path().stem().string(),
+                                         toml::parse_file(getRecordPath(digest.value()).string()));
+            } catch (const std::exception& e) {
+                debug("Failed to parse lock record: " + std::string(e.what()));
+            }
+        }
+
+        auto lock = std::scoped_lock<std::mutex>(g_mLockfileMutex);
+
+        // Plugins without a record were installed before records were kept, so are unlocked
+        toml::table lockfile = readLockfile();
+        lockfile.insert_or_assign("version", 1);
+        lockfile.insert_or_assign("plugins", std::move(plugins));
+
+        writeTable(getLockfilePath(), lockfile);
+    }
+}
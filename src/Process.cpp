@@ -0,0 +1,318 @@
+#include "Process.hpp"
+#include "Jobserver.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace hyprload {
+    // How long a killed process group gets to exit on SIGTERM before it gets SIGKILL
+    static const std::chrono::milliseconds c_terminateGracePeriod = std::chrono::seconds(2);
+    // Without a pidfd exits can only be noticed by polling
+    static const int c_reapInterval = 50;
+    // Upper bound on a single wait, so cancellation is noticed even if a process ignores SIGTERM
+    static const int c_cancelCheckInterval = 250;
+
+    static std::mutex g_mRunningMutex;
+    static std::unordered_set<pid_t> g_sRunningProcesses;
+    static std::atomic<bool> g_bCancelled = false;
+
+    static void closeFd(fd_t& fd) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    Process::Process(const std::string& command, bool inheritJobserver) {
+        m_sCommand = command;
+        m_bInheritJobserver = inheritJobserver;
+    }
+
+    Process::~Process() {
+        if (m_iPid > 0 && !m_bExited) {
+            terminate();
+        }
+
+        closePipes();
+        closeFd(m_iPidfd);
+    }
+
+    hyprload::Result<std::monostate, std::string> Process::start() {
+        if (g_bCancelled) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Not starting command, hyprload is shutting down");
+        }
+
+        // Close-on-exec, so processes spawned concurrently don't hold each other's pipes open.
+        // Fds without it, like the jobserver's, are still inherited.
+        fd_t stdoutPipe[2];
+        fd_t stderrPipe[2];
+
+        if (pipe2(stdoutPipe, O_CLOEXEC) != 0) {
+            return hyprload::Result<std::monostate, std::string>::err("Failed to create pipe");
+        }
+
+        if (pipe2(stderrPipe, O_CLOEXEC) != 0) {
+            close(stdoutPipe[0]);
+            close(stdoutPipe[1]);
+            return hyprload::Result<std::monostate, std::string>::err("Failed to create pipe");
+        }
+
+        // Bigger pipes mean fewer wakeups for chatty builds, the kernel may refuse quietly
+        fcntl(stdoutPipe[0], F_SETPIPE_SZ, 1 << 20);
+        fcntl(stderrPipe[0], F_SETPIPE_SZ, 1 << 20);
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, stdoutPipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, stderrPipe[1], STDERR_FILENO);
+
+        // Added after the pipes so a jobserver copy landing on a pipe fd number cannot be redirected
+        if (m_bInheritJobserver && g_pJobserver) {
+            g_pJobserver->inheritFds(&actions);
+        }
+
+        // Hyprland's signal handling must not leak into the children
+        sigset_t noSignals;
+        sigset_t allSignals;
+        sigemptyset(&noSignals);
+        sigfillset(&allSignals);
+
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+        posix_spawnattr_setflags(&attributes,
+                                 POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK |
+                                     POSIX_SPAWN_SETSIGDEF);
+        posix_spawnattr_setpgroup(&attributes, 0);
+        posix_spawnattr_setsigmask(&attributes, &noSignals);
+        posix_spawnattr_setsigdefault(&attributes, &allSignals);
+
+        const char* argv[] = {"/bin/sh", "-c", m_sCommand.c_str(), nullptr};
+
+        int spawnResult;
+        {
+            // Registered under the lock, so cancelAllProcesses can't miss it
+            auto lock = std::scoped_lock<std::mutex>(g_mRunningMutex);
+
+            spawnResult = posix_spawn(&m_iPid, "/bin/sh", &actions, &attributes,
+                                      const_cast<char* const*>(argv), environ);
+
+            if (spawnResult == 0) {
+                g_sRunningProcesses.insert(m_iPid);
+            }
+        }
+
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attributes);
+
+        close(stdoutPipe[1]);
+        close(stderrPipe[1]);
+
+        if (spawnResult != 0) {
+            close(stdoutPipe[0]);
+            close(stderrPipe[0]);
+            m_iPid = -1;
+
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to execute command: " + std::string(strerror(spawnResult)));
+        }
+
+        m_iStdoutFd = stdoutPipe[0];
+        m_iStderrFd = stderrPipe[0];
+        fcntl(m_iStdoutFd, F_SETFL, O_NONBLOCK);
+        fcntl(m_iStderrFd, F_SETFL, O_NONBLOCK);
+
+        m_iPidfd = syscall(SYS_pidfd_open, m_iPid, 0);
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    bool Process::poll() {
+        if (m_bExited) {
+            return true;
+        }
+
+        readOutput();
+
+        return reap(false);
+    }
+
+    SProcessResult Process::wait(std::optional<std::chrono::milliseconds> timeout) {
+        auto deadline = std::chrono::steady_clock::now() +
+            timeout.value_or(std::chrono::milliseconds::zero());
+
+        while (m_iPid > 0 && !poll()) {
+            if (g_bCancelled) {
+                m_sResult.m_bCancelled = true;
+                terminate();
+                break;
+            }
+
+            int pollTimeout = m_iPidfd >= 0 ? c_cancelCheckInterval : c_reapInterval;
+
+            if (timeout.has_value()) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+
+                if (remaining.count() <= 0) {
+                    m_sResult.m_bTimedOut = true;
+                    terminate();
+                    break;
+                }
+
+                pollTimeout = std::min<i64>(pollTimeout, remaining.count());
+            }
+
+            pollfd fds[3];
+            nfds_t count = 0;
+
+            for (fd_t fd : {m_iStdoutFd, m_iStderrFd, m_iPidfd}) {
+                if (fd >= 0) {
+                    fds[count++] = pollfd{.fd = fd, .events = POLLIN, .revents = 0};
+                }
+            }
+
+            ::poll(fds, count, pollTimeout);
+        }
+
+        return m_sResult;
+    }
+
+    void Process::kill(int signal) {
+        if (m_iPid > 0 && !m_bExited) {
+            // The shell's children share its process group
+            ::kill(-m_iPid, signal);
+        }
+    }
+
+    pid_t Process::getPid() const {
+        return m_iPid;
+    }
+
+    fd_t Process::getPidfd() const {
+        return m_iPidfd;
+    }
+
+    void Process::readOutput() {
+        char buffer[65536];
+
+        for (auto [fd, output] : {std::make_pair(&m_iStdoutFd, &m_sResult.m_sStdout),
+                                  std::make_pair(&m_iStderrFd, &m_sResult.m_sStderr)}) {
+            while (*fd >= 0) {
+                ssize_t count = read(*fd, buffer, sizeof(buffer));
+
+                if (count > 0) {
+                    output->append(buffer, count);
+                } else if (count == 0) {
+                    closeFd(*fd);
+                } else if (errno != EINTR) {
+                    break;
+                }
+            }
+        }
+    }
+
+    void Process::closePipes() {
+        closeFd(m_iStdoutFd);
+        closeFd(m_iStderrFd);
+    }
+
+    bool Process::reap(bool block) {
+        if (m_bExited) {
+            return true;
+        }
+
+        int status;
+        pid_t result;
+
+        do {
+            result = waitpid(m_iPid, &status, block ? 0 : WNOHANG);
+        } while (result < 0 && errno == EINTR);
+
+        if (result == 0) {
+            return false;
+        }
+
+        m_bExited = true;
+
+        {
+            auto lock = std::scoped_lock<std::mutex>(g_mRunningMutex);
+            g_sRunningProcesses.erase(m_iPid);
+        }
+
+        if (result > 0 && WIFEXITED(status)) {
+            m_sResult.m_iExitCode = WEXITSTATUS(status);
+        } else if (result > 0 && WIFSIGNALED(status)) {
+            m_sResult.m_iExitCode = 128 + WTERMSIG(status);
+        }
+
+        if (g_bCancelled) {
+            m_sResult.m_bCancelled = true;
+        }
+
+        // Whatever was written before the exit is still buffered in the pipes. Anything the
+        // process left running in the background may keep them open, so don't wait for EOF.
+        readOutput();
+        closePipes();
+        closeFd(m_iPidfd);
+
+        return true;
+    }
+
+    void Process::terminate() {
+        kill(SIGTERM);
+
+        auto deadline = std::chrono::steady_clock::now() + c_terminateGracePeriod;
+
+        while (!poll() && std::chrono::steady_clock::now() < deadline) {
+            usleep(c_reapInterval * 1000);
+        }
+
+        kill(SIGKILL);
+        reap(true);
+    }
+
+    void cancelAllProcesses() {
+        g_bCancelled = true;
+
+        auto lock = std::scoped_lock<std::mutex>(g_mRunningMutex);
+
+        // Waiting threads notice the exits and finish the kill themselves
+        for (pid_t pid : g_sRunningProcesses) {
+            ::kill(-pid, SIGTERM);
+        }
+    }
+
+    SProcessResult runCommand(const std::string& command,
+                              std::optional<std::chrono::milliseconds> timeout,
+                              bool inheritJobserver) {
+        Process process(command, inheritJobserver);
+
+        auto result = process.start();
+
+        if (result.isErr()) {
+            SProcessResult failed;
+            failed.m_sStderr = result.unwrapErr();
+            failed.m_bCancelled = g_bCancelled;
+
+            return failed;
+        }
+
+        return process.wait(timeout);
+    }
+}
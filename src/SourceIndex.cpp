@@ -0,0 +1,190 @@
+#include "SourceIndex.hpp"
+#include "Hash.hpp"
+#include "Hyprload.hpp"
+#include "util.hpp"
+
+#include "toml/toml.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace hyprload::index {
+    static std::mutex g_mIndexMutex;
+
+    static std::filesystem::path getIndexPath(const std::filesystem::path& sourcePath) {
+        return getSourceIndexPath() / (hash::sha256(sourcePath.string()).substr(0, 16) + ".toml");
+    }
+
+    static std::vector<std::string> listSourceFiles(const std::filesystem::path& sourcePath) {
+        std::vector<std::string> files;
+
+        if (std::filesystem::exists(sourcePath / ".git")) {
+            // git knows the ignore rules best, tracked and untracked but not ignored files
+            std::string command = "git -C " + sourcePath.string() +
+                " ls-files -z --cached --others --exclude-standard";
+
+            auto [exit, output] = executeCommand(command);
+
+            if (exit == 0) {
+                for (usize start = 0, end; start < output.size(); start = end + 1) {
+                    end = output.find('\0', start);
+
+                    if (end == std::string::npos) {
+                        end = output.size();
+                    }
+
+                    files.push_back(output.substr(start, end - start));
+                }
+
+                std::sort(files.begin(), files.end());
+
+                return files;
+            }
+        }
+
+        std::error_code ec;
+        auto it = std::filesystem::recursive_directory_iterator(sourcePath, ec);
+
+        for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            std::string filename = it->path().filename();
+
+            if (filename[0] == '.') {
+                if (it->is_directory(ec)) {
+                    it.disable_recursion_pending();
+                }
+
+                continue;
+            }
+
+            if (it->is_regular_file(ec)) {
+                files.push_back(std::filesystem::relative(it->path(), sourcePath, ec));
+            }
+        }
+
+        std::sort(files.begin(), files.end());
+
+        return files;
+    }
+
+    std::optional<std::string> getSourceFingerprint(const std::filesystem::path& sourcePath) {
+        if (!std::filesystem::exists(sourcePath)) {
+            return std::nullopt;
+        }
+
+        std::vector<std::string> files = listSourceFiles(sourcePath);
+        std::vector<std::string> entries = std::vector<std::string>(files.size());
+
+        // Stat calls are cheap but many, split them over the cores
+        usize threads = std::clamp<usize>(files.size() / 256, 1,
+                                          std::max(1u, std::thread::hardware_concurrency()));
+        usize chunk = (files.size() + threads - 1) / threads;
+
+        std::vector<std::future<void>> workers;
+
+        for (usize start = 0; start < files.size(); start += chunk) {
+            workers.push_back(std::async(std::launch::async, [&, start]() {
+                for (usize i = start; i < std::min(start + chunk, files.size()); i++) {
+                    struct stat fileStat;
+
+                    if (stat((sourcePath / files[i]).c_str(), &fileStat) != 0) {
+                        entries[i] = files[i] + " missing";
+                        continue;
+                    }
+
+                    entries[i] = files[i] + " " + std::to_string(fileStat.st_size) + " " +
+                        std::to_string(fileStat.st_mtim.tv_sec) + "." +
+                        std::to_string(fileStat.st_mtim.tv_nsec) + " " +
+                        std::to_string(fileStat.st_ino);
+                }
+            }));
+        }
+
+        for (auto& worker : workers) {
+            worker.wait();
+        }
+
+        hash::Sha256 hasher;
+        hasher.update(g_pHyprload->getCurrentHyprlandCommitHash());
+        hasher.update("\n");
+
+        for (const auto& entry : entries) {
+            hasher.update(entry);
+            hasher.update("\n");
+        }
+
+        return hasher.finish();
+    }
+
+    bool isSourceUnchanged(const std::filesystem::path& sourcePath,
+                           const std::vector<std::string>& names) {
+        toml::table index;
+
+        {
+            auto lock = std::scoped_lock<std::mutex>(g_mIndexMutex);
+
+            try {
+                index = toml::parse_file(getIndexPath(sourcePath).string());
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+
+        const toml::table* plugins = index["plugins"].as_table();
+
+        if (!plugins || names.empty()) {
+            return false;
+        }
+
+        std::optional<std::string> fingerprint = getSourceFingerprint(sourcePath);
+
+        if (!fingerprint.has_value()) {
+            return false;
+        }
+
+        return std::all_of(names.begin(), names.end(), [plugins, &fingerprint](const auto& name) {
+            return (*plugins)[name].value_or(std::string()) == fingerprint.value();
+        });
+    }
+
+    void recordBuild(const std::filesystem::path& sourcePath, const std::string& name,
+                     const std::optional<std::string>& fingerprint) {
+        auto lock = std::scoped_lock<std::mutex>(g_mIndexMutex);
+
+        std::filesystem::path indexPath = getIndexPath(sourcePath);
+        toml::table index;
+
+        try {
+            index = toml::parse_file(indexPath.string());
+        } catch (const std::exception&) {
+            index = toml::table{
+                {"source", sourcePath.string()},
+                {"plugins", toml::table()},
+            };
+        }
+
+        if (!index["plugins"].is_table()) {
+            index.insert_or_assign("plugins", toml::table());
+        }
+
+        // An empty fingerprint never matches, so a failed plugin gets built again
+        index["plugins"].as_table()->insert_or_assign(name, fingerprint.value_or(std::string()));
+
+        std::error_code ec;
+        std::filesystem::create_directories(indexPath.parent_path(), ec);
+
+        std::filesystem::path temporaryPath = indexPath;
+        temporaryPath += ".tmp";
+
+        std::ofstream indexFile(temporaryPath);
+        indexFile << index << "\n";
+        indexFile.close();
+
+        std::filesystem::rename(temporaryPath, indexPath, ec);
+    }
+}
@@ -0,0 +1,236 @@
+#include "SourceWatcher.hpp"
+#include "Hyprload.hpp"
+#include "util.hpp"
+
+#include <hyprland/src/Compositor.hpp>
+
+#include <algorithm>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+
+namespace hyprload {
+    // Saving a file is often several writes and renames, wait for them to settle
+    static const int c_settleDelay = 500;
+
+    static const u32 c_watchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+        IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+    static bool isIgnoredName(const std::string& name) {
+        // Hidden files and directories, editor swap and backup files
+        return name.empty() || name[0] == '.' || name.back() == '~';
+    }
+
+    SourceWatcher::SourceWatcher() {
+        m_iInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (m_iInotifyFd < 0) {
+            error("Failed to watch plugin sources");
+            return;
+        }
+
+        m_pEventSource = wl_event_loop_add_fd(g_pCompositor->m_sWLEventLoop, m_iInotifyFd,
+                                              WL_EVENT_READABLE, onEvents, this);
+        m_pSettleTimer = wl_event_loop_add_timer(g_pCompositor->m_sWLEventLoop, onSettled, this);
+    }
+
+    SourceWatcher::~SourceWatcher() {
+        if (m_pSettleTimer) {
+            wl_event_source_remove(m_pSettleTimer);
+        }
+
+        if (m_pEventSource) {
+            wl_event_source_remove(m_pEventSource);
+        }
+
+        if (m_iInotifyFd >= 0) {
+            close(m_iInotifyFd);
+        }
+    }
+
+    void SourceWatcher::watch(const std::vector<plugin::PluginRequirement>& requirements) {
+        for (const auto& [descriptor, watch] : m_mWatches) {
+            inotify_rm_watch(m_iInotifyFd, descriptor);
+        }
+
+        m_mWatches.clear();
+
+        // Keep what the last builds wrote, so sources watched again don't rebuild over it
+        std::unordered_map<std::string, std::unordered_set<std::string>> lastBuildPaths;
+
+        for (auto& source : m_vSources) {
+            lastBuildPaths[source.m_pPath.string()] = std::move(source.m_sLastBuildPaths);
+        }
+
+        m_vSources.clear();
+
+        if (m_iInotifyFd < 0) {
+            return;
+        }
+
+        for (const auto& requirement : requirements) {
+            auto source =
+                std::dynamic_pointer_cast<plugin::LocalPluginSource>(requirement.getSource());
+
+            if (!source) {
+                continue;
+            }
+
+            auto watched = std::find_if(m_vSources.begin(), m_vSources.end(),
+                                        [&source](const SWatchedSource& watched) {
+                                            return watched.m_pPath == source->getSourcePath();
+                                        });
+
+            if (watched != m_vSources.end()) {
+                watched->m_vRequirements.push_back(requirement);
+                continue;
+            }
+
+            m_vSources.push_back(SWatchedSource{
+                .m_pPath = source->getSourcePath(),
+                .m_vRequirements = {requirement},
+                .m_sLastBuildPaths = std::move(lastBuildPaths[source->getSourcePath().string()]),
+            });
+        }
+
+        for (usize i = 0; i < m_vSources.size(); i++) {
+            addWatches(m_vSources[i].m_pPath, i);
+        }
+
+        debug("Watching " + std::to_string(m_vSources.size()) + " local plugin sources");
+    }
+
+    void SourceWatcher::finishBuild() {
+        // Whatever is still queued was written before the build finished
+        readEvents(true);
+
+        bool changed = false;
+
+        for (auto& source : m_vSources) {
+            // A build rewrites the same outputs every time, so paths that also changed during
+            // the last build are its own. The first build of a source may rebuild once more.
+            source.m_bChanged = source.m_bChanged ||
+                std::any_of(source.m_sBuildPaths.begin(), source.m_sBuildPaths.end(),
+                            [&source](const std::string& path) {
+                                return !source.m_sLastBuildPaths.contains(path);
+                            });
+
+            source.m_sLastBuildPaths = std::move(source.m_sBuildPaths);
+            source.m_sBuildPaths.clear();
+
+            changed = changed || source.m_bChanged;
+        }
+
+        // Changes that settled during the build were left for now
+        if (changed && m_pSettleTimer) {
+            wl_event_source_timer_update(m_pSettleTimer, c_settleDelay);
+        }
+    }
+
+    int SourceWatcher::onEvents(fd_t, u32, void* data) {
+        auto* watcher = static_cast<SourceWatcher*>(data);
+
+        watcher->readEvents(g_pHyprload->isBuilding());
+
+        if (std::any_of(watcher->m_vSources.begin(), watcher->m_vSources.end(),
+                        [](const SWatchedSource& source) { return source.m_bChanged; })) {
+            // Every event pushes the rebuild back, so a burst of writes builds once
+            wl_event_source_timer_update(watcher->m_pSettleTimer, c_settleDelay);
+        }
+
+        return 0;
+    }
+
+    int SourceWatcher::onSettled(void* data) {
+        static_cast<SourceWatcher*>(data)->rebuildChanged();
+
+        return 0;
+    }
+
+    void SourceWatcher::addWatches(const std::filesystem::path& directory, usize source) {
+        int descriptor = inotify_add_watch(m_iInotifyFd, directory.c_str(), c_watchMask);
+
+        if (descriptor < 0) {
+            debug("Failed to watch " + directory.string());
+            return;
+        }
+
+        m_mWatches[descriptor] = std::make_pair(source, directory);
+
+        std::error_code ec;
+
+        for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+            if (entry.is_directory(ec) && !entry.is_symlink(ec) &&
+                !isIgnoredName(entry.path().filename())) {
+                addWatches(entry.path(), source);
+            }
+        }
+    }
+
+    void SourceWatcher::readEvents(bool building) {
+        alignas(inotify_event) char buffer[65536];
+        ssize_t count;
+
+        while ((count = read(m_iInotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char* it = buffer; it < buffer + count;) {
+                auto* event = reinterpret_cast<inotify_event*>(it);
+                it += sizeof(inotify_event) + event->len;
+
+                auto watch = m_mWatches.find(event->wd);
+
+                if (watch == m_mWatches.end()) {
+                    continue;
+                }
+
+                auto [source, directory] = watch->second;
+
+                if (event->mask & IN_IGNORED) {
+                    m_mWatches.erase(watch);
+                    continue;
+                }
+
+                std::string name = event->len > 0 ? std::string(event->name) : std::string();
+
+                if (event->len > 0 && isIgnoredName(name)) {
+                    continue;
+                }
+
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    addWatches(directory / name, source);
+                }
+
+                if (building) {
+                    m_vSources[source].m_sBuildPaths.insert((directory / name).string());
+                } else {
+                    m_vSources[source].m_bChanged = true;
+                }
+            }
+        }
+    }
+
+    void SourceWatcher::rebuildChanged() {
+        // Can't tell the build's own writes apart yet, the build finishing re-arms the timer
+        if (g_pHyprload->isBuilding()) {
+            return;
+        }
+
+        std::vector<plugin::PluginRequirement> requirements;
+
+        for (auto& source : m_vSources) {
+            if (!source.m_bChanged) {
+                continue;
+            }
+
+            info("Source changed, rebuilding: " + source.m_pPath.string());
+
+            source.m_bChanged = false;
+            requirements.insert(requirements.end(), source.m_vRequirements.begin(),
+                                source.m_vRequirements.end());
+        }
+
+        if (!requirements.empty()) {
+            g_pHyprload->buildPlugins(requirements);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#include "StartupSnapshot.hpp"
+#include "Hash.hpp"
+#include "HyprloadConfig.hpp"
+#include "util.hpp"
+
+#include "toml/toml.hpp"
+
+#include <fstream>
+
+#include <sys/stat.h>
+
+namespace hyprload::snapshot {
+    static std::filesystem::path getSnapshotPath() {
+        return getRootPath() / "startup.toml";
+    }
+
+    // Generations are never changed, so the one plugins/bin points to identifies the binaries.
+    // The directory's mtime covers a plugins/bin from before generations.
+    static std::string getBinariesKey() {
+        std::error_code ec;
+        std::filesystem::path target = std::filesystem::read_symlink(getPluginBinariesPath(), ec);
+
+        struct stat binariesStat;
+
+        if (stat(getPluginBinariesPath().c_str(), &binariesStat) != 0) {
+            return "";
+        }
+
+        return target.string() + ":" + std::to_string(binariesStat.st_mtim.tv_sec) + "." +
+            std::to_string(binariesStat.st_mtim.tv_nsec);
+    }
+
+    std::optional<SStartupSnapshot> readSnapshot() {
+        toml::table snapshot;
+
+        try {
+            snapshot = toml::parse_file(getSnapshotPath().string());
+        } catch (const std::exception&) {
+            return std::nullopt;
+        }
+
+        std::optional<std::string> configHash = hash::sha256File(config::getConfigPath());
+
+        if (!configHash.has_value() ||
+            snapshot["config"].value_or(std::string()) != configHash.value() ||
+            snapshot["binaries"].value_or(std::string()) != getBinariesKey()) {
+            return std::nullopt;
+        }
+
+        SStartupSnapshot result;
+
+        if (const toml::array* plugins = snapshot["plugins"].as_array()) {
+            for (const auto& plugin : *plugins) {
+                result.m_vPlugins.push_back(plugin.value_or(std::string()));
+            }
+        }
+
+        if (const toml::table* lazy = snapshot["lazy"].as_table()) {
+            for (const auto& [plugin, dispatchers] : *lazy) {
+                std::vector<std::string>& pluginDispatchers =
+                    result.m_mLazyDispatchers[std::string(plugin.str())];
+
+                if (const toml::array* array = dispatchers.as_array()) {
+                    for (const auto& dispatcher : *array) {
+                        pluginDispatchers.push_back(dispatcher.value_or(std::string()));
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+    void writeSnapshot(const SStartupSnapshot& snapshot) {
+        std::optional<std::string> configHash = hash::sha256File(config::getConfigPath());
+
+        if (!configHash.has_value()) {
+            return;
+        }
+
+        toml::array plugins;
+
+        for (const auto& plugin : snapshot.m_vPlugins) {
+            plugins.push_back(plugin);
+        }
+
+        toml::table lazy;
+
+        for (const auto& [plugin, dispatchers] : snapshot.m_mLazyDispatchers) {
+            toml::array pluginDispatchers;
+
+            for (const auto& dispatcher : dispatchers) {
+                pluginDispatchers.push_back(dispatcher);
+            }
+
+            lazy.insert_or_assign(plugin, std::move(pluginDispatchers));
+        }
+
+        toml::table table = toml::table{
+            {"config", configHash.value()},
+            {"binaries", getBinariesKey()},
+            {"plugins", std::move(plugins)},
+            {"lazy", std::move(lazy)},
+        };
+
+        std::filesystem::path snapshotPath = getSnapshotPath();
+        std::filesystem::path temporaryPath = snapshotPath;
+        temporaryPath += ".tmp";
+
+        std::ofstream snapshotFile(temporaryPath);
+        snapshotFile << table << "\n";
+        snapshotFile.close();
+
+        std::error_code ec;
+        std::filesystem::rename(temporaryPath, snapshotPath, ec);
+    }
+}
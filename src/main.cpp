@@ -21,6 +21,8 @@
 
 #include "Hyprload.hpp"
 #include "HyprloadConfig.hpp"
+#include "Janitor.hpp"
+#include "SourceWatcher.hpp"
 
 // Do NOT change this function.
 APICALL EXPORT std::string PLUGIN_API_VERSION() {
@@ -38,6 +40,10 @@ void hyprloadDispatcher(std::string command) {
         hyprload::g_pHyprload->installPlugins();
     } else if (command == "update") {
         hyprload::g_pHyprload->updatePlugins();
+    } else if (command == "publish") {
+        hyprload::g_pHyprload->publishPlugins();
+    } else if (command == "rollback") {
+        hyprload::g_pHyprload->rollbackPlugins();
     } else {
         hyprload::error("Unknown command: " + command);
     }
@@ -46,6 +52,7 @@ void hyprloadDispatcher(std::string command) {
 APICALL EXPORT PLUGIN_DESCRIPTION_INFO PLUGIN_INIT(HANDLE handle) {
     PHANDLE = handle;
     hyprload::g_pHyprload = std::make_unique<hyprload::Hyprload>();
+    hyprload::g_pJanitor = std::make_unique<hyprload::Janitor>();
 
     std::string home = getenv("HOME");
     std::string defaultPluginDir = home + std::string("/.local/share/hyprload/");
@@ -62,6 +69,34 @@ APICALL EXPORT PLUGIN_DESCRIPTION_INFO PLUGIN_INIT(HANDLE handle) {
         HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginQuiet, SConfigValue{.intValue = 0});
     configWasCreated = configWasCreated &&
         HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginDebug, SConfigValue{.intValue = 0});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginJobs, SConfigValue{.intValue = 0});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginCompileJobs,
+                                    SConfigValue{.intValue = 0});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginFullHeaderBuild,
+                                    SConfigValue{.intValue = 0});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginGitMirrors,
+                                    SConfigValue{.intValue = 1});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginNetworkTimeout,
+                                    SConfigValue{.intValue = 600});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginWatch, SConfigValue{.intValue = 0});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginRemoteCheckTtl,
+                                    SConfigValue{.intValue = 60});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginArtifactStore,
+                                    SConfigValue{.strValue = STRVAL_EMPTY});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginGenerations,
+                                    SConfigValue{.intValue = 5});
+    configWasCreated = configWasCreated &&
+        HyprlandAPI::addConfigValue(PHANDLE, hyprload::c_pluginGenerationMaxAge,
+                                    SConfigValue{.intValue = 0});
 
     configWasCreated = configWasCreated &&
         HyprlandAPI::addConfigValue(PHANDLE, hyprload::config::c_pluginConfig,
@@ -82,21 +117,16 @@ APICALL EXPORT PLUGIN_DESCRIPTION_INFO PLUGIN_INIT(HANDLE handle) {
         hyprload::error("Please update hyprload with the hyprload update dispatcher", 10000);
     }
 
-    HyprlandAPI::registerCallbackDynamic(PHANDLE, "tick", [](void*, SCallbackInfo&, std::any) {
-        hyprload::g_pHyprload->handleTick();
-    });
-
     hyprload::config::g_pHyprloadConfig = std::make_unique<hyprload::config::HyprloadConfig>();
 
     hyprload::success("Initialized successfully!");
 
-    hyprload::info("Cleaning up old sessions...");
-
-    hyprload::tryCleanupPreviousSessions();
-
-    for (auto& plugin : hyprload::config::g_pHyprloadConfig->getPlugins()) {
-        hyprload::debug("Want to load plugin: " + plugin.getName() +
-                        "\n\tBinary Path: " + plugin.getBinaryPath().string());
+    // Parsing the config just to log it would undo the startup snapshot
+    if (hyprload::isDebug()) {
+        for (auto& plugin : hyprload::config::g_pHyprloadConfig->getPlugins()) {
+            hyprload::debug("Want to load plugin: " + plugin.getName() +
+                            "\n\tBinary Path: " + plugin.getBinaryPath().string());
+        }
     }
 
     hyprload::info("Loading plugins...");
@@ -105,13 +135,25 @@ APICALL EXPORT PLUGIN_DESCRIPTION_INFO PLUGIN_INIT(HANDLE handle) {
 
     hyprload::success("Plugins loaded!");
 
+    hyprload::info("Cleaning up old sessions...");
+
+    hyprload::g_pHyprload->cleanupPreviousSessions();
+
+    hyprload::g_pHyprload->setupSourceWatcher();
+
     return {"hyprload", "Hyprland plugin manager", "Duckonaut", "1.4.0"};
 }
 
 APICALL EXPORT void PLUGIN_EXIT() {
     hyprload::debug("Unloading plugin...");
 
+    hyprload::g_pSourceWatcher = nullptr;
+
+    hyprload::g_pHyprload->shutdownBuildScheduler();
+
     hyprload::g_pHyprload->cleanupPlugin();
 
+    hyprload::g_pJanitor = nullptr;
+
     hyprload::debug("Unloaded successfully!");
 }
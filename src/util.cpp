@@ -1,13 +1,21 @@
 #include "types.hpp"
 #include "globals.hpp"
 #include "util.hpp"
+#include "Process.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <optional>
+#include <thread>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/fs.h>
 
 #include <hyprland/src/SharedDefs.hpp>
 #include <hyprland/src/debug/Log.hpp>
@@ -52,6 +60,10 @@ namespace hyprload {
         return getRootPath() / "include";
     }
 
+    std::filesystem::path getHyprlandHeadersStampPath() {
+        return getRootPath() / "include" / "hyprland.stamp";
+    }
+
     std::filesystem::path getPkgConfigOverridePath() {
         return getRootPath() / "pkgconfig";
     }
@@ -68,6 +80,30 @@ namespace hyprload {
         return getPluginsPath() / "bin";
     }
 
+    std::filesystem::path getPluginMirrorsPath() {
+        return getPluginsPath() / "mirrors";
+    }
+
+    std::filesystem::path getPluginStagingPath() {
+        return getRootPath() / "staging";
+    }
+
+    std::filesystem::path getPluginStorePath() {
+        return getRootPath() / "store";
+    }
+
+    std::filesystem::path getPluginGenerationsPath() {
+        return getRootPath() / "generations";
+    }
+
+    std::filesystem::path getBuildCachePath() {
+        return getRootPath() / "cache";
+    }
+
+    std::filesystem::path getSourceIndexPath() {
+        return getRootPath() / "index";
+    }
+
     bool isQuiet() {
         static SConfigValue* hyprloadQuiet = HyprlandAPI::getConfigValue(PHANDLE, c_pluginQuiet);
 
@@ -80,6 +116,96 @@ namespace hyprload {
         return hyprloadDebug->intValue;
     }
 
+    usize getBuildJobCount() {
+        static SConfigValue* hyprloadJobs = HyprlandAPI::getConfigValue(PHANDLE, c_pluginJobs);
+
+        if (hyprloadJobs->intValue > 0) {
+            return hyprloadJobs->intValue;
+        }
+
+        // Every build runs its own make, so leave room for their own parallelism
+        return std::max<usize>(1, std::thread::hardware_concurrency() / 2);
+    }
+
+    usize getCompileJobCount() {
+        static SConfigValue* hyprloadCompileJobs =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginCompileJobs);
+
+        if (hyprloadCompileJobs->intValue > 0) {
+            return hyprloadCompileJobs->intValue;
+        }
+
+        return std::max<usize>(1, std::thread::hardware_concurrency());
+    }
+
+    bool isFullHeaderBuild() {
+        static SConfigValue* hyprloadFullHeaderBuild =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginFullHeaderBuild);
+
+        return hyprloadFullHeaderBuild->intValue;
+    }
+
+    std::optional<std::chrono::seconds> getNetworkTimeout() {
+        static SConfigValue* hyprloadNetworkTimeout =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginNetworkTimeout);
+
+        if (hyprloadNetworkTimeout->intValue <= 0) {
+            return std::nullopt;
+        }
+
+        return std::chrono::seconds(hyprloadNetworkTimeout->intValue);
+    }
+
+    bool isGitMirrorsEnabled() {
+        static SConfigValue* hyprloadGitMirrors =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginGitMirrors);
+
+        return hyprloadGitMirrors->intValue;
+    }
+
+    bool isWatchEnabled() {
+        static SConfigValue* hyprloadWatch = HyprlandAPI::getConfigValue(PHANDLE, c_pluginWatch);
+
+        return hyprloadWatch->intValue;
+    }
+
+    std::chrono::seconds getRemoteCheckTtl() {
+        static SConfigValue* hyprloadRemoteCheckTtl =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginRemoteCheckTtl);
+
+        return std::chrono::seconds(std::max<int>(0, hyprloadRemoteCheckTtl->intValue));
+    }
+
+    std::optional<std::string> getArtifactStoreUrl() {
+        static SConfigValue* hyprloadArtifactStore =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginArtifactStore);
+
+        if (hyprloadArtifactStore->strValue.empty() ||
+            hyprloadArtifactStore->strValue == STRVAL_EMPTY) {
+            return std::nullopt;
+        }
+
+        return hyprloadArtifactStore->strValue;
+    }
+
+    usize getGenerationsToKeep() {
+        static SConfigValue* hyprloadGenerations =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginGenerations);
+
+        return std::max<int>(1, hyprloadGenerations->intValue);
+    }
+
+    std::optional<std::chrono::hours> getGenerationMaxAge() {
+        static SConfigValue* hyprloadGenerationMaxAge =
+            HyprlandAPI::getConfigValue(PHANDLE, c_pluginGenerationMaxAge);
+
+        if (hyprloadGenerationMaxAge->intValue <= 0) {
+            return std::nullopt;
+        }
+
+        return std::chrono::hours(24 * hyprloadGenerationMaxAge->intValue);
+    }
+
     void info(const std::string& message, usize duration) {
         std::string logMessage = "[hyprload] " + message;
         if (!isQuiet()) {
@@ -182,26 +308,142 @@ namespace hyprload {
         flock(lock, LOCK_UN);
     }
 
-    std::tuple<int, std::string> executeCommand(const std::string& command) {
-        std::string result = "";
-        FILE* pipe = popen(command.c_str(), "r");
-        if (!pipe) {
-            return std::make_tuple(-1, "Failed to execute command");
+    static bool copyContents(fd_t sourceFd, fd_t targetFd) {
+        ssize_t copied;
+
+        // Done in the kernel, which may share the blocks instead
+        while ((copied = copy_file_range(sourceFd, nullptr, targetFd, nullptr, 1 << 30, 0)) > 0) {}
+
+        if (copied == 0) {
+            return true;
+        }
+
+        // Not supported between these files, continue from wherever it stopped
+        char buffer[65536];
+        ssize_t count;
+
+        while ((count = read(sourceFd, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t written = 0; written < count;) {
+                ssize_t result = write(targetFd, buffer + written, count - written);
+
+                if (result < 0) {
+                    return false;
+                }
+
+                written += result;
+            }
+        }
+
+        return count == 0;
+    }
+
+    hyprload::Result<std::monostate, std::string> stageFile(const std::filesystem::path& source,
+                                                            const std::filesystem::path& target,
+                                                            bool shareInode) {
+        fd_t sourceFd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (sourceFd < 0) {
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to open " + source.string() + ": " + strerror(errno));
+        }
+
+        struct stat sourceStat;
+        fstat(sourceFd, &sourceStat);
+        mode_t mode = sourceStat.st_mode & 0777;
+
+        std::error_code ec;
+        std::filesystem::remove(target, ec);
+
+        fd_t targetFd = open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+
+        if (targetFd >= 0) {
+            if (ioctl(targetFd, FICLONE, sourceFd) == 0) {
+                close(targetFd);
+                close(sourceFd);
+                return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+            }
+
+            close(targetFd);
+            unlink(target.c_str());
+        }
+
+        if (shareInode && link(source.c_str(), target.c_str()) == 0) {
+            close(sourceFd);
+            return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+        }
+
+        // Across filesystems, copy into a file that only gets a name once it is complete
+        std::filesystem::path temporary = target;
+        temporary += ".tmp." + std::to_string(getpid()) + "." +
+            std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+        targetFd = open(target.parent_path().c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, mode);
+        bool anonymous = targetFd >= 0;
+
+        if (!anonymous) {
+            targetFd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+        }
+
+        if (targetFd < 0) {
+            close(sourceFd);
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to create " + target.string() + ": " + strerror(errno));
         }
 
-        char buffer[128];
-        while (!feof(pipe)) {
-            if (fgets(buffer, 128, pipe) != nullptr) {
-                result += buffer;
+        bool copied = copyContents(sourceFd, targetFd);
+        close(sourceFd);
+
+        bool named;
+        if (!copied) {
+            named = false;
+        } else if (anonymous) {
+            std::string procPath = "/proc/self/fd/" + std::to_string(targetFd);
+            named = linkat(AT_FDCWD, procPath.c_str(), AT_FDCWD, target.c_str(),
+                           AT_SYMLINK_FOLLOW) == 0;
+        } else {
+            named = rename(temporary.c_str(), target.c_str()) == 0;
+        }
+
+        int error = errno;
+        close(targetFd);
+
+        if (!named) {
+            if (!anonymous) {
+                unlink(temporary.c_str());
             }
+
+            return hyprload::Result<std::monostate, std::string>::err(
+                "Failed to copy " + source.string() + " to " + target.string() + ": " +
+                strerror(error));
+        }
+
+        return hyprload::Result<std::monostate, std::string>::ok(std::monostate());
+    }
+
+    std::tuple<int, std::string> executeCommand(const std::string& command,
+                                                std::optional<std::chrono::seconds> timeout,
+                                                bool inheritJobserver) {
+        SProcessResult result = runCommand(command, timeout, inheritJobserver);
+
+        std::string output = result.m_sStdout;
+
+        // Callers report the output of failed commands, where the reason is usually on stderr
+        if (result.m_iExitCode != 0) {
+            output += result.m_sStderr;
+        }
+
+        if (result.m_bTimedOut) {
+            output += "Command timed out after " + std::to_string(timeout.value().count()) + "s";
+        } else if (result.m_bCancelled) {
+            output += "Command cancelled";
         }
 
-        int exit = pclose(pipe);
+        int exit = result.m_bTimedOut || result.m_bCancelled ? -1 : result.m_iExitCode;
 
-        Debug::log(LOG, " [hyprload] Command: %s", command.c_str());
-        Debug::log(LOG, " [hyprload] Exit code: %d", exit);
-        Debug::log(LOG, " [hyprload] Result: %s", result.c_str());
+        Debug::log(LOG, " [hyprload] Command: {}", command);
+        Debug::log(LOG, " [hyprload] Exit code: {}", exit);
+        Debug::log(LOG, " [hyprload] Result: {}", output);
 
-        return std::make_tuple(exit, result);
+        return std::make_tuple(exit, output);
     }
 }